@@ -1,25 +1,59 @@
 #version 330 core
 layout(location = 0) out vec4 color_out;
+// variant: COMPACT_GBUFFER leaves out position and material, as terrain.frag does
+#ifdef COMPACT_GBUFFER
+layout(location = 1) out vec2 norm_out;
+#else
 layout(location = 1) out vec4 pos_out;
 layout(location = 2) out vec4 norm_out;
 layout(location = 3) out vec4 mat_out;
+#endif
 
 in vec2 TexCoords;
 in mat3 TBN;
 in vec3 WorldPos;
 
 uniform sampler2D texture_diffuse1;
+// variant (ShaderVariants.h): NORMAL_MAP perturbs the normal with texture_normal1, without it the
+// interpolated vertex normal is used
+#ifdef NORMAL_MAP
 uniform sampler2D texture_normal1;
+#endif
+
+#ifdef COMPACT_GBUFFER
+// index into fbo.frag's MATERIALS
+const float MATERIAL_ID = 1.0;
+
+// the same encoding as terrain.frag's, fbo.frag decodes it
+vec2 octEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return n.xy * 0.5 + 0.5;
+}
+#endif
 
 void main()
 {
-    // Calculate normal from normal map
-    vec3 fragNor = texture(texture_normal1, TexCoords).xyz;
-    fragNor = normalize(2.0 * fragNor - 1.0);
+#ifdef NORMAL_MAP
+    // Calculate normal from normal map. only x and y are read, baked (BC5) normal maps don't store z
+    vec3 fragNor;
+    fragNor.xy = 2.0 * texture(texture_normal1, TexCoords).xy - 1.0;
+    fragNor.z = sqrt(max(1.0 - dot(fragNor.xy, fragNor.xy), 0.0));
     fragNor = normalize(TBN * fragNor);
+#else
+    vec3 fragNor = normalize(TBN[2]);
+#endif
     
+#ifdef COMPACT_GBUFFER
+    color_out = vec4(texture(texture_diffuse1, TexCoords).rgb, MATERIAL_ID / 255.0);
+    norm_out = octEncode(fragNor);
+#else
     color_out = vec4(texture(texture_diffuse1, TexCoords).rgb, 1.0);
     pos_out = vec4(WorldPos, 1.0);
     norm_out = vec4(fragNor, 1.0);
     mat_out = vec4(1.0, 1.0, 0, 0);
+#endif
 }
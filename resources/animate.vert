@@ -2,7 +2,8 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in vec3 aTangent;
+// w holds the bitangent sign for packed vertices
+layout (location = 3) in vec4 aTangent;
 layout (location = 4) in vec3 aBitangent;
 layout (location = 5) in ivec4 aBoneIds;
 layout (location = 6) in vec4 aBoneWeights;
@@ -12,30 +13,122 @@ out mat3 TBN;
 out vec3 WorldPos;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// see FrameUniforms.h
+layout (std140) uniform FrameBlock {
+    mat4 projection;
+    mat4 view;
+    vec3 campos;
+    float time;
+    vec3 skyColor;
+    mat4 inverseViewProjection;
+};
+
+// variants (ShaderVariants.h, Model::shaderDefines):
+//   SKINNED             moves vertices with the bones of AnimationBlock, without it they stay in model space
+//   DUAL_QUAT_SKINNING  the palette holds dual quaternions instead of matrices
+//   PACKED_VERTICES     meshes uploaded as PackedVertex, see Mesh.h
+//   BONE_COUNT          bones in the palette, MAX_BONES
+#ifndef BONE_COUNT
+#define BONE_COUNT 110
+#endif
 
+#ifdef SKINNED
+// 4 matrix columns per bone, or real + dual part per bone with DUAL_QUAT_SKINNING
 layout (std140) uniform AnimationBlock {
-    mat4 animationTransforms[110];
+#ifdef DUAL_QUAT_SKINNING
+    vec4 bonePalette[2 * BONE_COUNT];
+#else
+    vec4 bonePalette[4 * BONE_COUNT];
+#endif
 };
+#endif
+
+#if defined(SKINNED) && !defined(DUAL_QUAT_SKINNING)
+mat4 boneMatrix(int id)
+{
+    return mat4(bonePalette[4*id], bonePalette[4*id+1], bonePalette[4*id+2], bonePalette[4*id+3]);
+}
+#endif
 
+// rotate v by the unit quaternion q
+vec3 quatRotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// inverse of octEncode in Mesh.h
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
 
 void main()
 {
+#ifdef PACKED_VERTICES
+    vec3 inNormal = octDecode(aNormal.xy);
+    vec3 inTangent = octDecode(aTangent.xy);
+    vec3 inBitangent = cross(inNormal, inTangent) * (aTangent.w < 0.0 ? -1.0 : 1.0);
+#else
+    vec3 inNormal = aNormal;
+    vec3 inTangent = aTangent.xyz;
+    vec3 inBitangent = aBitangent;
+#endif
+
+    vec3 pos, normal, tangent, bitangent;
+#if defined(SKINNED) && defined(DUAL_QUAT_SKINNING)
+    // blend the dual quaternions of each bone affecting this vertex
+    vec4 first = bonePalette[2*aBoneIds[0]];
+    vec4 real = vec4(0.0);
+    vec4 dual = vec4(0.0);
+    for (int i = 0; i < 4; i++) {
+        vec4 r = bonePalette[2*aBoneIds[i]];
+        // q and -q are the same rotation, keep them all on the side of the first bone
+        float w = dot(first, r) < 0.0 ? -aBoneWeights[i] : aBoneWeights[i];
+        real += r * w;
+        dual += bonePalette[2*aBoneIds[i]+1] * w;
+    }
+    float len = length(real);
+    if (len < 1e-6) {
+        real = vec4(0.0, 0.0, 0.0, 1.0);
+        dual = vec4(0.0);
+        len = 1.0;
+    }
+    real /= len;
+    dual /= len;
+    vec3 translation = 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+
+    pos = quatRotate(real, aPos) + translation;
+    normal = quatRotate(real, inNormal);
+    tangent = quatRotate(real, inTangent);
+    bitangent = quatRotate(real, inBitangent);
+#elif defined(SKINNED)
     // accumulate animation transforms from each bone affecting this vertex
-    mat4 trans = animationTransforms[aBoneIds[0]] * aBoneWeights[0];
-    trans += animationTransforms[aBoneIds[1]] * aBoneWeights[1];
-    trans += animationTransforms[aBoneIds[2]] * aBoneWeights[2];
-    trans += animationTransforms[aBoneIds[3]] * aBoneWeights[3];
-    
-    mat4 mTrans = model * trans;
-    
-    vec3 normal = normalize((mTrans * vec4(aNormal, 0.0)).xyz);
-    vec3 tangent = normalize((mTrans * vec4(aTangent, 0.0)).xyz);
-    vec3 bitangent = normalize((mTrans * vec4(aBitangent, 0.0)).xyz);
+    mat4 trans = boneMatrix(aBoneIds[0]) * aBoneWeights[0];
+    trans += boneMatrix(aBoneIds[1]) * aBoneWeights[1];
+    trans += boneMatrix(aBoneIds[2]) * aBoneWeights[2];
+    trans += boneMatrix(aBoneIds[3]) * aBoneWeights[3];
+
+    pos = (trans * vec4(aPos, 1.0)).xyz;
+    normal = (trans * vec4(inNormal, 0.0)).xyz;
+    tangent = (trans * vec4(inTangent, 0.0)).xyz;
+    bitangent = (trans * vec4(inBitangent, 0.0)).xyz;
+#else
+    pos = aPos;
+    normal = inNormal;
+    tangent = inTangent;
+    bitangent = inBitangent;
+#endif
+
+    normal = normalize((model * vec4(normal, 0.0)).xyz);
+    tangent = normalize((model * vec4(tangent, 0.0)).xyz);
+    bitangent = normalize((model * vec4(bitangent, 0.0)).xyz);
     TBN = mat3(tangent, bitangent, normal);
-    
+
     TexCoords = aTexCoords;
-    gl_Position = projection * view * mTrans * vec4(aPos, 1.0);
-    WorldPos = (mTrans * vec4(aPos, 1.0)).xyz;
+    WorldPos = (model * vec4(pos, 1.0)).xyz;
+    gl_Position = projection * view * vec4(WorldPos, 1.0);
 }
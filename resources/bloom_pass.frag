@@ -4,29 +4,23 @@ out vec4 color;
 in vec2 fragTex;
 
 uniform sampler2D image;
-uniform int horizontal;
 uniform float weight[9] = float[] (0.227027, 0.1945946,0.1945946, 0.1216216,0.1216216, 0.054054,0.054054, 0.016216, 0.016216);
 
+// variant (ShaderVariants.h): HORIZONTAL blurs along x, without it along y
+#ifdef HORIZONTAL
+const vec2 direction = vec2(1.0, 0.0);
+#else
+const vec2 direction = vec2(0.0, 1.0);
+#endif
 
 void main()
 {             
-    vec2 tex_offset = 1.0 / textureSize(image, 0); // gets size of single texel
+    vec2 tex_offset = direction / textureSize(image, 0); // gets size of single texel along the blur
     vec3 result = texture(image, fragTex).rgb * weight[0]; // current fragment's contribution
-    if(horizontal==1)
+    for(int i = 1; i < 9; ++i)
     {
-        for(int i = 1; i < 9; ++i)
-        {
-            result += texture(image, fragTex + vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-            result += texture(image, fragTex - vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-        }
-    }
-    else
-    {
-        for(int i = 1; i < 9; ++i)
-        {
-            result += texture(image, fragTex + vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-            result += texture(image, fragTex - vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-        }
+        result += texture(image, fragTex + tex_offset * float(i)).rgb * weight[i];
+        result += texture(image, fragTex - tex_offset * float(i)).rgb * weight[i];
     }
     color = vec4(result, 1.0);
 	
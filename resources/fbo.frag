@@ -8,9 +8,34 @@ uniform sampler2D colTex;
 uniform sampler2D posTex;
 uniform sampler2D norTex;
 uniform sampler2D matTex;
+// variants (ShaderVariants.h): FOG blends distant fragments into the sky, COMPACT_GBUFFER reads the compact
+// G-buffer: position rebuilt from depth, normals octahedron encoded in norTex and the material id in colTex's alpha
+#if defined(FOG) || defined(COMPACT_GBUFFER)
 uniform sampler2D depthTexture;
-uniform vec3 skyColor;
-uniform vec3 campos;
+#endif
+// see FrameUniforms.h
+layout (std140) uniform FrameBlock {
+    mat4 projection;
+    mat4 view;
+    vec3 campos;
+    float time;
+    vec3 skyColor;
+    mat4 inverseViewProjection;
+};
+
+#ifdef COMPACT_GBUFFER
+// diffuse, specular and ambient of each material id, terrain.frag writes 0 and animate.frag 1
+const vec3 MATERIALS[2] = vec3[](vec3(1.0, 0.0, 0.15), vec3(1.0, 1.0, 0.0));
+
+vec3 octDecode(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+#endif
 
 vec3 calcDirectionalLight(vec3 lightDir, vec3 lightCol, vec3 normal, vec3 WorldPos, vec3 material) 
 {
@@ -35,16 +60,34 @@ vec3 calcDirectionalLight(vec3 lightDir, vec3 lightCol, vec3 normal, vec3 WorldP
 
 void main()
 {
+#ifdef COMPACT_GBUFFER
+    vec4 colMat = texture(colTex, TexCoords);
+    vec3 col = colMat.rgb;
+    float depth = texture(depthTexture, TexCoords).r;
+    vec3 worldPos, normal, material;
+    if (depth == 1.0) {
+        // sky, the full layout holds the clear colour in every target
+        worldPos = normal = material = skyColor;
+    }
+    else {
+        vec4 world = inverseViewProjection * vec4(vec3(TexCoords, depth) * 2.0 - 1.0, 1.0);
+        worldPos = world.xyz / world.w;
+        normal = octDecode(texture(norTex, TexCoords).rg);
+        material = MATERIALS[min(int(colMat.a * 255.0 + 0.5), 1)];
+    }
+#else
     vec3 col = texture(colTex, TexCoords).rgb;
 	vec3 worldPos = texture(posTex, TexCoords).rgb;
 	vec3 normal = texture(norTex, TexCoords).rgb;
     vec3 material = texture(matTex, TexCoords).rgb;
+#endif
 
    
     // Lighting
     vec3 lightCol = calcDirectionalLight(vec3(100,100,100), vec3(1,1,1), normal, worldPos, material);
     col = col * lightCol;
 
+#ifdef FOG
     // Fog
     float n = 1.0;
     float f = 100.0f;
@@ -54,6 +97,7 @@ void main()
     col.x = min(col.x, skyColor.x);
     col.y = min(col.y, skyColor.y);
     col.z = min(col.z, skyColor.z);
+#endif
 
     FragColor = vec4(col, 1.0);
 
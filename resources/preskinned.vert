@@ -0,0 +1,29 @@
+#version 330 core
+// draws vertices already skinned into world space by the skinning stage (animate.vert with transform feedback)
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+
+out vec2 TexCoords;
+out mat3 TBN;
+out vec3 WorldPos;
+
+// see FrameUniforms.h
+layout (std140) uniform FrameBlock {
+    mat4 projection;
+    mat4 view;
+    vec3 campos;
+    float time;
+    vec3 skyColor;
+    mat4 inverseViewProjection;
+};
+
+void main()
+{
+    TBN = mat3(aTangent, aBitangent, aNormal);
+    TexCoords = aTexCoords;
+    WorldPos = aPos;
+    gl_Position = projection * view * vec4(aPos, 1.0);
+}
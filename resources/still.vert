@@ -10,9 +10,16 @@ layout (location = 6) in vec4 aBoneWeights;
 out vec2 TexCoords;
 out vec3 FragNor;
 
-uniform mat4 projection;
 uniform mat4 model;
-uniform mat4 view;
+// see FrameUniforms.h
+layout (std140) uniform FrameBlock {
+    mat4 projection;
+    mat4 view;
+    vec3 campos;
+    float time;
+    vec3 skyColor;
+    mat4 inverseViewProjection;
+};
 
 void main() {
     gl_Position = projection * view * model * vec4(aPos.xyz, 1.0);
@@ -1,12 +1,33 @@
 #version 330 core
 layout(location = 0) out vec4 color_out;
+// variant (ShaderVariants.h): COMPACT_GBUFFER writes the normal octahedron encoded and the material id into the
+// colour's alpha, the lighting pass rebuilds the position from depth. the full layout writes all of them as floats
+#ifdef COMPACT_GBUFFER
+layout(location = 1) out vec2 norm_out;
+#else
 layout(location = 1) out vec4 pos_out;
 layout(location = 2) out vec4 norm_out;
 layout(location = 3) out vec4 mat_out;
+#endif
 
 flat in vec3 fragNor;
 in vec3 WorldPos;
 
+#ifdef COMPACT_GBUFFER
+// index into fbo.frag's MATERIALS
+const float MATERIAL_ID = 0.0;
+
+// unit normal folded onto the octahedron and unrolled into [0, 1]^2
+vec2 octEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return n.xy * 0.5 + 0.5;
+}
+#endif
+
 void main() {
     //vec3 normal = normalize(fragNor);
     //vec3 light = normalize(lightDir);
@@ -17,10 +38,15 @@ void main() {
     //col += color * 0.15;
     //Outcolor = vec4(col, 1.0);
 
+#ifdef COMPACT_GBUFFER
+    color_out = vec4(0.05, 0.5, 0.2, MATERIAL_ID / 255.0);
+    norm_out = octEncode(normalize(fragNor));
+#else
     color_out = vec4(0.05, 0.5, 0.2, 1.0);
     pos_out = vec4(WorldPos, 1.0);
     norm_out = vec4(normalize(fragNor), 1.0);
     mat_out = vec4(1.0, 0, 0.15, 0);
+#endif
 }
 
 
@@ -1,9 +1,16 @@
 #version  330 core
 layout(location = 0) in vec3 vertPos;
 layout(location = 1) in vec3 vertNor;
-uniform mat4 projection;
 uniform mat4 model;
-uniform mat4 view;
+// see FrameUniforms.h
+layout (std140) uniform FrameBlock {
+    mat4 projection;
+    mat4 view;
+    vec3 campos;
+    float time;
+    vec3 skyColor;
+    mat4 inverseViewProjection;
+};
 
 flat out vec3 fragNor;
 out vec3 WorldPos;
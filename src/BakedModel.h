@@ -0,0 +1,327 @@
+#ifndef BAKED_MODEL_H
+#define BAKED_MODEL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Baked model format (.tfm), written by Model::Bake and mapped straight into memory by the loader.
+// Everything the runtime needs from an imported scene is stored GPU-ready, so loading is a
+// handful of glBufferData calls on pointers into the mapping:
+//
+//   BakedHeader
+//   BakedMesh[meshCount]
+//   BakedTexture[textureCount]     textures of every mesh, each mesh owns a contiguous range
+//   BakedBone[boneCount]           skeleton tree in pre-order, parents before children
+//   BakedKey[keyCount]             keyframes of all bones
+//   BakedLod[lodCount]             levels of detail past the full mesh, each mesh owns a contiguous range
+//   BakedCluster[clusterCount]     clusters of the full detail index lists, each mesh owns a contiguous range
+//   Vertex[vertexCount]            interleaved vertices of all meshes
+//   unsigned int[indexCount]       indices of all meshes, relative to the mesh's first vertex
+//   unsigned int[lodIndexCount]    indices of all levels of detail, relative to the mesh's first vertex
+//
+// Levels of detail and clusters are built at import (see MeshSimplifier.h and Meshlets.h) and
+// stored, so a baked model loads without running either.
+//
+// Sections start on 16 byte boundaries. Files are native endian and tied to the Vertex layout,
+// the loader rejects files whose version or vertex stride doesn't match and they have to be baked again.
+namespace baked {
+
+    const char MAGIC[4] = {'T', 'F', 'B', 'M'};
+    const uint32_t VERSION = 2;
+
+    struct BakedHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t vertexStride;
+        uint32_t meshCount;
+        uint32_t textureCount;
+        uint32_t boneCount;
+        uint32_t keyCount;
+        uint32_t isAnimated;
+        uint32_t lodCount;
+        uint32_t clusterCount;
+        uint64_t vertexCount;
+        uint64_t indexCount;
+        uint64_t lodIndexCount;
+        // section offsets from the start of the file
+        uint64_t meshesOffset;
+        uint64_t texturesOffset;
+        uint64_t bonesOffset;
+        uint64_t keysOffset;
+        uint64_t lodsOffset;
+        uint64_t clustersOffset;
+        uint64_t verticesOffset;
+        uint64_t indicesOffset;
+        uint64_t lodIndicesOffset;
+        // animation clip
+        float animDuration;
+        float animTicks;
+        float inverseBindTransform[16];
+        // bind pose bounding sphere, for picking the level of detail
+        float boundsCenter[3];
+        float boundsRadius;
+    };
+
+    struct BakedMesh {
+        uint64_t firstVertex;
+        uint64_t firstIndex;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t firstTexture;
+        uint32_t textureCount;
+        uint32_t firstLod;
+        uint32_t lodCount;
+        uint32_t firstCluster;
+        uint32_t clusterCount;
+    };
+
+    struct BakedTexture {
+        char type[32];
+        char path[224];
+    };
+
+    struct BakedBone {
+        char name[64];
+        int32_t loc;
+        int32_t parent;
+        uint32_t isBone;
+        uint32_t positionKeyCount;
+        uint32_t scaleKeyCount;
+        uint32_t rotationKeyCount;
+        // position keys, then scale keys, then rotation keys
+        uint64_t firstKey;
+        float boneOffset[16];
+    };
+
+    // firstIndex counts into the level of detail indices, error is the accumulated one of Mesh::Lod
+    struct BakedLod {
+        uint64_t firstIndex;
+        uint32_t indexCount;
+        float error;
+    };
+
+    // a meshlets::Meshlet, firstIndex relative to the mesh's full detail index list
+    struct BakedCluster {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        float center[3];
+        float radius;
+        float coneAxis[3];
+        float coneCutoff;
+        int32_t bone;
+        uint32_t rigid;
+    };
+
+    // vec3 keys use value[0..2], rotation keys hold a quaternion as x, y, z, w
+    struct BakedKey {
+        double time;
+        float value[4];
+    };
+
+    inline uint64_t alignSection(uint64_t offset) {
+        return (offset + 15) & ~uint64_t(15);
+    }
+
+    // read only memory mapping of a whole file, unmapped when destroyed
+    class MappedFile {
+    public:
+        MappedFile(std::string const &path) {
+#ifdef _WIN32
+            file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE) {
+                return;
+            }
+            LARGE_INTEGER fileSize;
+            GetFileSizeEx(file, &fileSize);
+            size = (size_t)fileSize.QuadPart;
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping != NULL) {
+                bytes = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            }
+#else
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return;
+            }
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                size = (size_t)st.st_size;
+                void *ptr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (ptr != MAP_FAILED) {
+                    bytes = (const unsigned char *)ptr;
+                }
+            }
+            // the mapping stays valid after the descriptor is closed
+            close(fd);
+#endif
+            if (!bytes) {
+                size = 0;
+            }
+        }
+
+        ~MappedFile() {
+#ifdef _WIN32
+            if (bytes) UnmapViewOfFile(bytes);
+            if (mapping != NULL) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+            if (bytes) munmap((void *)bytes, size);
+#endif
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        const unsigned char *data() const { return bytes; }
+        size_t length() const { return size; }
+
+        template<typename T>
+        const T *at(uint64_t offset) const {
+            return reinterpret_cast<const T *>(bytes + offset);
+        }
+
+    private:
+        const unsigned char *bytes = nullptr;
+        size_t size = 0;
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = NULL;
+#endif
+    };
+
+    // whether count elements of elementSize at offset lie inside a file of length bytes, on a section boundary
+    inline bool sectionFits(size_t length, uint64_t offset, uint64_t count, size_t elementSize) {
+        if (elementSize == 0 || offset % 16 != 0 || offset > length) {
+            return false;
+        }
+        return count <= (length - offset) / elementSize;
+    }
+
+    // whether [first, first + count) lies inside total elements
+    inline bool rangeFits(uint64_t first, uint64_t count, uint64_t total) {
+        return first <= total && count <= total - first;
+    }
+
+    // whether a fixed size string field holds its terminating NUL
+    inline bool terminated(const char *field, size_t size) {
+        return memchr(field, '\0', size) != nullptr;
+    }
+
+    // whether every index of a list points into a mesh of vertexCount vertices
+    inline bool indicesFit(const uint32_t *indices, uint64_t count, uint32_t vertexCount) {
+        for (uint64_t n = 0; n < count; n++) {
+            if (indices[n] >= vertexCount) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // checks everything the loader reads from a mapped file against its length and against the limits of
+    // the runtime (maxBones palette slots, maxLods levels of detail per mesh past the full one), so a truncated
+    // or corrupt file can't make it read out of bounds. nullptr if the file can be loaded, otherwise what is wrong with it
+    inline const char *validate(const MappedFile &file, int maxBones, unsigned int maxLods) {
+        size_t length = file.length();
+        if (!file.data() || length < sizeof(BakedHeader)) {
+            return "shorter than its header";
+        }
+        const BakedHeader &header = *file.at<BakedHeader>(0);
+        if (!sectionFits(length, header.meshesOffset, header.meshCount, sizeof(BakedMesh)) ||
+            !sectionFits(length, header.texturesOffset, header.textureCount, sizeof(BakedTexture)) ||
+            !sectionFits(length, header.bonesOffset, header.boneCount, sizeof(BakedBone)) ||
+            !sectionFits(length, header.keysOffset, header.keyCount, sizeof(BakedKey)) ||
+            !sectionFits(length, header.lodsOffset, header.lodCount, sizeof(BakedLod)) ||
+            !sectionFits(length, header.clustersOffset, header.clusterCount, sizeof(BakedCluster)) ||
+            !sectionFits(length, header.verticesOffset, header.vertexCount, header.vertexStride) ||
+            !sectionFits(length, header.indicesOffset, header.indexCount, sizeof(uint32_t)) ||
+            !sectionFits(length, header.lodIndicesOffset, header.lodIndexCount, sizeof(uint32_t))) {
+            return "a section runs past the end of the file";
+        }
+
+        const BakedMesh *meshes = file.at<BakedMesh>(header.meshesOffset);
+        const uint32_t *indices = file.at<uint32_t>(header.indicesOffset);
+        const BakedLod *lods = file.at<BakedLod>(header.lodsOffset);
+        const uint32_t *lodIndices = file.at<uint32_t>(header.lodIndicesOffset);
+        const BakedCluster *clusters = file.at<BakedCluster>(header.clustersOffset);
+        for (uint32_t i = 0; i < header.meshCount; i++) {
+            const BakedMesh &mesh = meshes[i];
+            if (!rangeFits(mesh.firstVertex, mesh.vertexCount, header.vertexCount) ||
+                !rangeFits(mesh.firstIndex, mesh.indexCount, header.indexCount) ||
+                !rangeFits(mesh.firstTexture, mesh.textureCount, header.textureCount) ||
+                !rangeFits(mesh.firstLod, mesh.lodCount, header.lodCount) ||
+                !rangeFits(mesh.firstCluster, mesh.clusterCount, header.clusterCount)) {
+                return "a mesh's vertices, indices, textures, levels of detail or clusters lie outside their section";
+            }
+            if (!indicesFit(indices + mesh.firstIndex, mesh.indexCount, mesh.vertexCount)) {
+                return "an index points past its mesh's vertices";
+            }
+            if (mesh.lodCount > maxLods) {
+                return "a mesh has more levels of detail than the runtime draws";
+            }
+            for (uint32_t l = 0; l < mesh.lodCount; l++) {
+                const BakedLod &lod = lods[mesh.firstLod + l];
+                if (!rangeFits(lod.firstIndex, lod.indexCount, header.lodIndexCount)) {
+                    return "a level of detail's indices lie outside their section";
+                }
+                if (!indicesFit(lodIndices + lod.firstIndex, lod.indexCount, mesh.vertexCount)) {
+                    return "a level of detail index points past its mesh's vertices";
+                }
+            }
+            for (uint32_t c = 0; c < mesh.clusterCount; c++) {
+                const BakedCluster &cluster = clusters[mesh.firstCluster + c];
+                if (!rangeFits(cluster.firstIndex, cluster.indexCount, mesh.indexCount)) {
+                    return "a cluster lies outside its mesh's indices";
+                }
+                if (cluster.bone < -1 || cluster.bone >= maxBones) {
+                    return "a cluster's bone is out of range";
+                }
+            }
+        }
+
+        const BakedTexture *textures = file.at<BakedTexture>(header.texturesOffset);
+        for (uint32_t i = 0; i < header.textureCount; i++) {
+            if (!terminated(textures[i].type, sizeof(textures[i].type)) || !terminated(textures[i].path, sizeof(textures[i].path))) {
+                return "a texture type or path is not terminated";
+            }
+        }
+
+        const BakedBone *bones = file.at<BakedBone>(header.bonesOffset);
+        for (uint32_t i = 0; i < header.boneCount; i++) {
+            const BakedBone &bone = bones[i];
+            if (!terminated(bone.name, sizeof(bone.name))) {
+                return "a bone name is not terminated";
+            }
+            // pre-order, the root first and every parent before its children
+            if (i == 0 ? bone.parent != -1 : bone.parent < 0 || (uint32_t)bone.parent >= i) {
+                return "a bone's parent does not come before it";
+            }
+            if (bone.isBone && (bone.loc < 0 || bone.loc >= maxBones)) {
+                return "a bone's palette slot is out of range";
+            }
+            uint64_t keyCount = (uint64_t)bone.positionKeyCount + bone.scaleKeyCount + bone.rotationKeyCount;
+            if (!rangeFits(bone.firstKey, keyCount, header.keyCount)) {
+                return "a bone's keys lie outside their section";
+            }
+        }
+        return nullptr;
+    }
+}
+#endif
@@ -0,0 +1,191 @@
+#ifndef CPU_SKINNING_H
+#define CPU_SKINNING_H
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CPU_SKINNING_SSE 1
+#endif
+
+// Skinning of mesh positions on the CPU, for collision and hit tests against the deformed dragon.
+// Uses linear blend skinning with the matrix palette (Model::animationTransforms) whatever the
+// model skins with on the GPU, which is close enough for collision proxies.
+namespace cpu_skinning {
+
+    // reference implementation: transforms the position by each of the vertex's bones and blends the results,
+    // the same math as the SIMD path so the benchmark compares only the vectorization
+    inline void skinPositionsScalar(const Vertex *vertices, const glm::mat4 *palette, const unsigned int *subset, size_t count, glm::vec3 *out)
+    {
+        for (size_t n = 0; n < count; n++) {
+            const Vertex &v = vertices[subset ? subset[n] : n];
+            glm::vec4 position(v.Position, 1.0f);
+            glm::vec4 skinned(0.0f);
+            for (int b = 0; b < MAX_BONES_VERTEX; b++) {
+                skinned += (palette[v.boneIds[b]] * position) * v.boneWeights[b];
+            }
+            out[n] = glm::vec3(skinned);
+        }
+    }
+
+#ifdef CPU_SKINNING_SSE
+    // one vertex at a time, the lanes holding x, y, z and w: each bone's columns are four loads and the bones of
+    // a vertex are blended in registers
+    inline void skinPositionsSSE(const Vertex *vertices, const glm::mat4 *palette, const unsigned int *subset, size_t count, glm::vec3 *out)
+    {
+        for (size_t n = 0; n < count; n++) {
+            const Vertex &v = vertices[subset ? subset[n] : n];
+            __m128 x = _mm_set1_ps(v.Position.x);
+            __m128 y = _mm_set1_ps(v.Position.y);
+            __m128 z = _mm_set1_ps(v.Position.z);
+            __m128 acc = _mm_setzero_ps();
+            for (int b = 0; b < MAX_BONES_VERTEX; b++) {
+                // glm matrices are 16 contiguous floats, column major
+                const float *m = &palette[v.boneIds[b]][0][0];
+                __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m), x), _mm_mul_ps(_mm_loadu_ps(m + 4), y)),
+                                      _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m + 8), z), _mm_loadu_ps(m + 12)));
+                acc = _mm_add_ps(acc, _mm_mul_ps(r, _mm_set1_ps(v.boneWeights[b])));
+            }
+            float result[4];
+            _mm_storeu_ps(result, acc);
+            out[n] = glm::vec3(result[0], result[1], result[2]);
+        }
+    }
+
+    // four vertices at a time in SoA form, each lane one vertex: the bone matrices of the lanes are transposed
+    // column by column so x, y and z of all four come out of the same multiply-adds. the rest goes through
+    // the scalar path. every lane reads its own bones, so the transposes cost more than the wider math saves
+    // and skinPositions uses the path above, the benchmark times both
+    inline void skinPositionsSSE4(const Vertex *vertices, const glm::mat4 *palette, const unsigned int *subset, size_t count, glm::vec3 *out)
+    {
+        size_t n = 0;
+        for (; n + 4 <= count; n += 4) {
+            const Vertex *v[4];
+            for (int lane = 0; lane < 4; lane++) {
+                v[lane] = &vertices[subset ? subset[n + lane] : n + lane];
+            }
+            // _mm_set_ps takes the lanes from last to first
+            __m128 px = _mm_set_ps(v[3]->Position.x, v[2]->Position.x, v[1]->Position.x, v[0]->Position.x);
+            __m128 py = _mm_set_ps(v[3]->Position.y, v[2]->Position.y, v[1]->Position.y, v[0]->Position.y);
+            __m128 pz = _mm_set_ps(v[3]->Position.z, v[2]->Position.z, v[1]->Position.z, v[0]->Position.z);
+            __m128 sx = _mm_setzero_ps(), sy = _mm_setzero_ps(), sz = _mm_setzero_ps();
+            for (int b = 0; b < MAX_BONES_VERTEX; b++) {
+                // glm matrices are 16 contiguous floats, column major
+                const float *m0 = &palette[v[0]->boneIds[b]][0][0];
+                const float *m1 = &palette[v[1]->boneIds[b]][0][0];
+                const float *m2 = &palette[v[2]->boneIds[b]][0][0];
+                const float *m3 = &palette[v[3]->boneIds[b]][0][0];
+                __m128 weight = _mm_set_ps(v[3]->boneWeights[b], v[2]->boneWeights[b], v[1]->boneWeights[b], v[0]->boneWeights[b]);
+                __m128 rx = _mm_setzero_ps(), ry = _mm_setzero_ps(), rz = _mm_setzero_ps();
+                for (int c = 0; c < 4; c++) {
+                    // column c of each lane's matrix, transposed into its x, y, z (and unused w) across the lanes
+                    __m128 cx = _mm_loadu_ps(m0 + 4 * c), cy = _mm_loadu_ps(m1 + 4 * c);
+                    __m128 cz = _mm_loadu_ps(m2 + 4 * c), cw = _mm_loadu_ps(m3 + 4 * c);
+                    _MM_TRANSPOSE4_PS(cx, cy, cz, cw);
+                    if (c < 3) {
+                        __m128 p = c == 0 ? px : (c == 1 ? py : pz);
+                        rx = _mm_add_ps(rx, _mm_mul_ps(cx, p));
+                        ry = _mm_add_ps(ry, _mm_mul_ps(cy, p));
+                        rz = _mm_add_ps(rz, _mm_mul_ps(cz, p));
+                    }
+                    else {
+                        // the translation, the position's w is 1
+                        rx = _mm_add_ps(rx, cx);
+                        ry = _mm_add_ps(ry, cy);
+                        rz = _mm_add_ps(rz, cz);
+                    }
+                }
+                sx = _mm_add_ps(sx, _mm_mul_ps(rx, weight));
+                sy = _mm_add_ps(sy, _mm_mul_ps(ry, weight));
+                sz = _mm_add_ps(sz, _mm_mul_ps(rz, weight));
+            }
+            float x[4], y[4], z[4];
+            _mm_storeu_ps(x, sx);
+            _mm_storeu_ps(y, sy);
+            _mm_storeu_ps(z, sz);
+            for (int lane = 0; lane < 4; lane++) {
+                out[n + lane] = glm::vec3(x[lane], y[lane], z[lane]);
+            }
+        }
+        // the last count % 4 vertices
+        if (subset) {
+            skinPositionsScalar(vertices, palette, subset + n, count - n, out + n);
+        }
+        else {
+            skinPositionsScalar(vertices + n, palette, nullptr, count - n, out + n);
+        }
+    }
+#endif
+
+    // skins the positions of mesh with palette into out, in the space of transform (pass the model matrix for world space).
+    // subset lists the vertex indices to skin, such as a convex hull proxy or the wing tips, nullptr skins every vertex.
+    inline void skinPositions(const Mesh &mesh, const glm::mat4 *palette, const glm::mat4 &transform, const std::vector<unsigned int> *subset, std::vector<glm::vec3> &out)
+    {
+        // fold the transform into the palette once instead of applying it per vertex
+        glm::mat4 transformed[MAX_BONES];
+        for (int i = 0; i < MAX_BONES; i++) {
+            transformed[i] = transform * palette[i];
+        }
+
+        // meshes uploaded straight from a baked file keep no CPU geometry to skin
+        size_t count = mesh.vertices.empty() ? 0 : (subset ? subset->size() : mesh.vertices.size());
+        out.resize(count);
+        if (count == 0) {
+            return;
+        }
+        const unsigned int *indices = subset ? subset->data() : nullptr;
+#ifdef CPU_SKINNING_SSE
+        skinPositionsSSE(mesh.vertices.data(), transformed, indices, count, out.data());
+#else
+        skinPositionsScalar(mesh.vertices.data(), transformed, indices, count, out.data());
+#endif
+    }
+
+    // indices of the vertices that bone moves by at least minWeight, e.g. to build a wing tip subset
+    inline std::vector<unsigned int> verticesInfluencedBy(const Mesh &mesh, int boneId, float minWeight = 0.5f)
+    {
+        std::vector<unsigned int> subset;
+        for (unsigned int i = 0; i < mesh.vertices.size(); i++) {
+            const Vertex &v = mesh.vertices[i];
+            for (int b = 0; b < MAX_BONES_VERTEX; b++) {
+                if (v.boneIds[b] == boneId && v.boneWeights[b] >= minWeight) {
+                    subset.push_back(i);
+                    break;
+                }
+            }
+        }
+        return subset;
+    }
+
+    // prints skinned vertices per second on this thread for the scalar and SIMD paths, which all compute the same
+    inline void benchmark(const Mesh &mesh, const glm::mat4 *palette)
+    {
+        typedef void (*SkinFunc)(const Vertex *, const glm::mat4 *, const unsigned int *, size_t, glm::vec3 *);
+        std::vector<std::pair<const char*, SkinFunc>> paths;
+        paths.push_back(std::make_pair("scalar", &skinPositionsScalar));
+#ifdef CPU_SKINNING_SSE
+        paths.push_back(std::make_pair("sse", &skinPositionsSSE));
+        paths.push_back(std::make_pair("sse, 4 vertices soa", &skinPositionsSSE4));
+#endif
+        std::vector<glm::vec3> out(mesh.vertices.size());
+        for (size_t p = 0; p < paths.size(); p++) {
+            // run for at least a quarter second to smooth out timer resolution
+            size_t skinned = 0;
+            auto start = std::chrono::steady_clock::now();
+            double seconds = 0.0;
+            while (seconds < 0.25) {
+                paths[p].second(mesh.vertices.data(), palette, nullptr, mesh.vertices.size(), out.data());
+                skinned += mesh.vertices.size();
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            std::cout << "cpu skinning (" << paths[p].first << "): " << skinned / seconds / 1.0e6 << " M vertices/s/core" << std::endl;
+        }
+    }
+}
+#endif
@@ -0,0 +1,129 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+
+#include <cstring>
+#include <iostream>
+
+// binding point of FrameBlock, 0 is the bone palette's AnimationBlock
+const GLuint FRAME_BLOCK_BINDING = 1;
+
+// FrameBlock as the shaders declare it, std140: a vec3 followed by a float shares one 16 byte slot
+struct FrameBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 campos;
+    float time;
+    glm::vec3 skyColor;
+    float padding;
+    // inverse(projection * view), takes the lighting pass from depth back to world space
+    glm::mat4 inverseViewProjection;
+};
+static_assert(sizeof(FrameBlock) == 224, "FrameBlock has to match the std140 layout of the shaders' FrameBlock");
+
+// The per-frame constants (camera, sky, time) every program reads from one uniform buffer at
+// FRAME_BLOCK_BINDING, written once a frame instead of as uniforms of each program. The buffer is a
+// ring of RING_SIZE blocks so a frame never writes the block the GPU may still be reading. With
+// GL 4.4 it stays mapped (persistent, coherent) and a fence guards each block, older contexts
+// (macOS), and frames whose fence did not signal in time, write the next block with glBufferSubData.
+class FrameUniforms
+{
+public:
+    FrameUniforms()
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = (sizeof(FrameBlock) + alignment - 1) / alignment * alignment;
+
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        if (GLAD_GL_VERSION_4_4) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            // dynamic storage keeps glBufferSubData working should the mapping fail
+            glBufferStorage(GL_UNIFORM_BUFFER, stride * RING_SIZE, NULL, flags | GL_DYNAMIC_STORAGE_BIT);
+            mapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, stride * RING_SIZE, flags);
+            if (!mapped) {
+                std::cout << "ERROR::FRAME_UNIFORMS:: could not map the frame ring, writing it with glBufferSubData" << std::endl;
+            }
+        }
+        if (!mapped && !GLAD_GL_VERSION_4_4) {
+            glBufferData(GL_UNIFORM_BUFFER, stride * RING_SIZE, NULL, GL_DYNAMIC_DRAW);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    ~FrameUniforms()
+    {
+        for (int i = 0; i < RING_SIZE; i++) {
+            if (fences[i]) {
+                glDeleteSync(fences[i]);
+            }
+        }
+        if (mapped) {
+            glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &UBO);
+    }
+
+    // points shader's FrameBlock at the frame ring, once after linking. programs without one are left alone
+    void attach(Shader *shader) const
+    {
+        GLuint block = shader->uniformBlock("FrameBlock");
+        if (block != GL_INVALID_INDEX) {
+            glUniformBlockBinding(shader->ID, block, FRAME_BLOCK_BINDING);
+        }
+    }
+
+    // writes the frame's constants into the next block of the ring and binds it, draws issued after this read them
+    void update(const FrameBlock &frame)
+    {
+        // everything issued so far read the current block, it is free once that is done
+        if (mapped) {
+            fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        current = (current + 1) % RING_SIZE;
+
+        size_t offset = current * stride;
+        bool blockFree = true;
+        if (mapped && fences[current]) {
+            // RING_SIZE frames back, this only blocks if the GPU is that far behind
+            GLenum result = glClientWaitSync(fences[current], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+            if (result == GL_WAIT_FAILED) {
+                std::cout << "ERROR::FRAME_UNIFORMS:: waiting on the frame ring failed, writing the block with glBufferSubData" << std::endl;
+            }
+            // a timeout leaves the block possibly still read, glBufferSubData is ordered after those reads by the driver
+            blockFree = result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+            glDeleteSync(fences[current]);
+            fences[current] = 0;
+        }
+        if (mapped && blockFree) {
+            memcpy(mapped + offset, &frame, sizeof(FrameBlock));
+        }
+        else {
+            glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+            glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(FrameBlock), &frame);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, UBO, offset, sizeof(FrameBlock));
+    }
+
+    FrameUniforms(const FrameUniforms &) = delete;
+    FrameUniforms &operator=(const FrameUniforms &) = delete;
+
+private:
+    static const int RING_SIZE = 3;
+    // a second, far longer than any frame takes
+    static const GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+    GLuint UBO = 0;
+    size_t stride = 0;
+    unsigned char *mapped = nullptr;
+    GLsync fences[RING_SIZE] = {};
+    int current = 0;
+};
+#endif
@@ -42,6 +42,143 @@ void printOpenGLErrors(const char *const Function, const char * const File, int
 	}
 }
 
+static bool debugOutput = false;
+// GL_KHR_debug on a context older than 4.3, its functions loaded by loadDebugOutput
+static bool khrDebug = false;
+
+void loadDebugOutput(GLADloadproc load)
+{
+	if (GLAD_GL_VERSION_4_3 || !hasExtension("GL_KHR_debug"))
+	{
+		return;
+	}
+	// the extension's functions carry no suffix in a core profile
+	glad_glDebugMessageCallback = (PFNGLDEBUGMESSAGECALLBACKPROC)load("glDebugMessageCallback");
+	glad_glDebugMessageControl = (PFNGLDEBUGMESSAGECONTROLPROC)load("glDebugMessageControl");
+	khrDebug = glad_glDebugMessageCallback != NULL && glad_glDebugMessageControl != NULL;
+}
+
+static const char *debugSourceString(GLenum source)
+{
+	switch (source) {
+	case GL_DEBUG_SOURCE_API:
+		return "API";
+	case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
+		return "Window system";
+	case GL_DEBUG_SOURCE_SHADER_COMPILER:
+		return "Shader compiler";
+	case GL_DEBUG_SOURCE_THIRD_PARTY:
+		return "Third party";
+	case GL_DEBUG_SOURCE_APPLICATION:
+		return "Application";
+	default:
+		return "Other";
+	}
+}
+
+static const char *debugTypeString(GLenum type)
+{
+	switch (type) {
+	case GL_DEBUG_TYPE_ERROR:
+		return "Error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+		return "Deprecated behavior";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+		return "Undefined behavior";
+	case GL_DEBUG_TYPE_PORTABILITY:
+		return "Portability";
+	case GL_DEBUG_TYPE_PERFORMANCE:
+		return "Performance";
+	case GL_DEBUG_TYPE_MARKER:
+		return "Marker";
+	default:
+		return "Other";
+	}
+}
+
+static const char *debugSeverityString(GLenum severity)
+{
+	switch (severity) {
+	case GL_DEBUG_SEVERITY_HIGH:
+		return "high";
+	case GL_DEBUG_SEVERITY_MEDIUM:
+		return "medium";
+	case GL_DEBUG_SEVERITY_LOW:
+		return "low";
+	default:
+		return "notification";
+	}
+}
+
+// may run on a driver thread when the output is asynchronous, so it only prints
+static void APIENTRY debugMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei, const GLchar *message, const void *)
+{
+	printf("OpenGL %s (%s, %s severity, id %u): %s\n", debugTypeString(type), debugSourceString(source), debugSeverityString(severity), id, message);
+}
+
+bool enableDebugOutput(bool synchronous, GLenum minSeverity)
+{
+	if (!GLAD_GL_VERSION_4_3 && !khrDebug)
+	{
+		return false;
+	}
+	glDebugMessageCallback(debugMessage, NULL);
+	glEnable(GL_DEBUG_OUTPUT);
+	if (synchronous)
+	{
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	}
+	else
+	{
+		glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	}
+
+	// everything from minSeverity up, severities from most to least severe
+	const GLenum severities[] = { GL_DEBUG_SEVERITY_HIGH, GL_DEBUG_SEVERITY_MEDIUM, GL_DEBUG_SEVERITY_LOW, GL_DEBUG_SEVERITY_NOTIFICATION };
+	bool enabled = true;
+	for (GLenum severity : severities)
+	{
+		glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, severity, 0, NULL, enabled);
+		if (severity == minSeverity)
+		{
+			enabled = false;
+		}
+	}
+	// debug groups only mark where a pass starts and ends
+	filterDebugOutput(GL_DONT_CARE, GL_DEBUG_TYPE_PUSH_GROUP, false);
+	filterDebugOutput(GL_DONT_CARE, GL_DEBUG_TYPE_POP_GROUP, false);
+
+	// whatever glGetError still holds from before, the callback only sees new errors
+	printOpenGLErrors("{{BEFORE}} enableDebugOutput", __FILE__, __LINE__);
+	debugOutput = true;
+	return true;
+}
+
+void disableDebugOutput()
+{
+	if (!debugOutput)
+	{
+		return;
+	}
+	glDisable(GL_DEBUG_OUTPUT);
+	glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageCallback(NULL, NULL);
+	debugOutput = false;
+}
+
+bool debugOutputEnabled()
+{
+	return debugOutput;
+}
+
+void filterDebugOutput(GLenum source, GLenum type, bool enabled)
+{
+	if (GLAD_GL_VERSION_4_3 || khrDebug)
+	{
+		glDebugMessageControl(source, type, GL_DONT_CARE, 0, NULL, enabled ? GL_TRUE : GL_FALSE);
+	}
+}
+
 void checkError(const char *str)
 {
 	GLenum glErr = glGetError();
@@ -117,6 +254,21 @@ void checkVersion()
 	}
 }
 
+bool hasExtension(const char *name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		const char *ext = (const char *) glGetStringi(GL_EXTENSIONS, i);
+		if (ext && strcmp(ext, name) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 GLint getAttribLocation(const GLuint program, const char varname[], bool verbose)
 {
 	GLint r = glGetAttribLocation(program, varname);
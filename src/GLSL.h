@@ -20,16 +20,36 @@ namespace GLSL
 	void printProgramInfoLog(GLuint program);
 	void printShaderInfoLog(GLuint shader);
 	void checkVersion();
+	bool hasExtension(const char *name);
 	GLint getAttribLocation(const GLuint program, const char varname[], bool verbose = true);
 	GLint getUniformLocation(const GLuint program, const char varname[], bool verbose = true);
 	void enableVertexAttribArray(const GLint handle);
 	void disableVertexAttribArray(const GLint handle);
 	void vertexAttribPointer(const GLint handle, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer);
+
+	// glad only loads glDebugMessageCallback and glDebugMessageControl with GL 4.3. loadDebugOutput also loads
+	// them when an older context has GL_KHR_debug. Call it once after gladLoadGLLoader, with the same loader
+	void loadDebugOutput(GLADloadproc load);
+	// Errors reported by the driver through glDebugMessageCallback (GL 4.3 or GL_KHR_debug) instead of polled with glGetError.
+	// Asynchronous by default, so a message can arrive after the call that caused it returned and on another thread;
+	// synchronous output reports it inside the call at some cost. Messages less severe than minSeverity are dropped.
+	// False where the callback isn't available (macOS stops at 4.1), CHECKED_GL_CALL then keeps polling glGetError
+	bool enableDebugOutput(bool synchronous = false, GLenum minSeverity = GL_DEBUG_SEVERITY_MEDIUM);
+	void disableDebugOutput();
+	bool debugOutputEnabled();
+	// turns the messages of source and type (GL_DONT_CARE for any) on or off, on top of the severity filter
+	void filterDebugOutput(GLenum source, GLenum type, bool enabled);
 }
 
+// release builds compile the checks out
+#if defined(NDEBUG) && !defined(DISABLE_OPENGL_ERROR_CHECKS)
+#define DISABLE_OPENGL_ERROR_CHECKS
+#endif
+
 
 #ifndef DISABLE_OPENGL_ERROR_CHECKS
-#define CHECKED_GL_CALL(x) do { GLSL::printOpenGLErrors("{{BEFORE}} "#x, __FILE__, __LINE__); (x); GLSL::printOpenGLErrors(#x, __FILE__, __LINE__); } while (0)
+// with debug output on the driver reports errors itself and the two glGetError round trips are skipped
+#define CHECKED_GL_CALL(x) do { if (GLSL::debugOutputEnabled()) { (x); } else { GLSL::printOpenGLErrors("{{BEFORE}} "#x, __FILE__, __LINE__); (x); GLSL::printOpenGLErrors(#x, __FILE__, __LINE__); } } while (0)
 #else
 #define CHECKED_GL_CALL(x) (x)
 #endif
@@ -0,0 +1,193 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+// Shadow of the context's binding state (program, VAO, 2D texture per unit, framebuffer, draw buffers,
+// viewport, enabled capabilities) that skips calls setting what is already set. Everything that changes
+// that state has to go through here, or call invalidate() afterwards, else the shadow is wrong and a
+// needed call is skipped. Objects have to be forgotten when they are deleted since GL reuses their names.
+// Counts the calls it issued and elided, report() prints the averages per frame.
+class GLState
+{
+public:
+    static GLState &instance()
+    {
+        static GLState state;
+        return state;
+    }
+
+    void useProgram(GLuint program)
+    {
+        if (elide(program == currentProgram)) {
+            return;
+        }
+        currentProgram = program;
+        glUseProgram(program);
+    }
+
+    void bindVertexArray(GLuint vao)
+    {
+        if (elide(vao == currentVertexArray)) {
+            return;
+        }
+        currentVertexArray = vao;
+        glBindVertexArray(vao);
+    }
+
+    // makes GL_TEXTURE0 + unit active, for calls that act on the active unit
+    void activeTexture(GLuint unit)
+    {
+        if (elide(unit == currentUnit)) {
+            return;
+        }
+        currentUnit = unit;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // binds texture to GL_TEXTURE_2D (the only target the renderer uses) of unit. the active unit only changes
+    // if the bind is issued, calls on the bound texture (glTexImage2D, glGenerateMipmap...) have to follow
+    // activeTexture(unit)
+    void bindTexture(GLuint unit, GLuint texture)
+    {
+        if (unit >= boundTextures.size()) {
+            boundTextures.resize(unit + 1, GLuint(UNKNOWN));
+        }
+        if (elide(boundTextures[unit] == texture)) {
+            return;
+        }
+        activeTexture(unit);
+        boundTextures[unit] = texture;
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    // binds fbo for both drawing and reading
+    void bindFramebuffer(GLuint fbo)
+    {
+        if (elide(fbo == currentFramebuffer)) {
+            return;
+        }
+        currentFramebuffer = fbo;
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    }
+
+    // the draw buffers of the bound framebuffer, they are part of its state so each remembers its own
+    void drawBuffers(GLsizei count, const GLenum *buffers)
+    {
+        std::vector<GLenum> &current = framebufferDrawBuffers[currentFramebuffer];
+        if (elide(currentFramebuffer != UNKNOWN && current.size() == (size_t)count && std::equal(buffers, buffers + count, current.begin()))) {
+            return;
+        }
+        current.assign(buffers, buffers + count);
+        glDrawBuffers(count, buffers);
+    }
+
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        if (elide(viewportKnown && x == currentViewport[0] && y == currentViewport[1] &&
+                  width == currentViewport[2] && height == currentViewport[3])) {
+            return;
+        }
+        viewportKnown = true;
+        currentViewport[0] = x;
+        currentViewport[1] = y;
+        currentViewport[2] = width;
+        currentViewport[3] = height;
+        glViewport(x, y, width, height);
+    }
+
+    // glEnable / glDisable of capability (GL_DEPTH_TEST, GL_RASTERIZER_DISCARD...)
+    void enable(GLenum capability, bool enabled = true)
+    {
+        auto it = capabilities.find(capability);
+        if (elide(it != capabilities.end() && it->second == enabled)) {
+            return;
+        }
+        capabilities[capability] = enabled;
+        if (enabled) {
+            glEnable(capability);
+        }
+        else {
+            glDisable(capability);
+        }
+    }
+
+    void disable(GLenum capability)
+    {
+        enable(capability, false);
+    }
+
+    // call before deleting a texture, a new one may get its name
+    void forgetTexture(GLuint texture)
+    {
+        for (GLuint &bound : boundTextures) {
+            if (bound == texture) {
+                bound = UNKNOWN;
+            }
+        }
+    }
+
+    // forgets everything, for after code that changes the state behind the shadow's back
+    void invalidate()
+    {
+        currentProgram = currentVertexArray = currentUnit = currentFramebuffer = UNKNOWN;
+        boundTextures.clear();
+        framebufferDrawBuffers.clear();
+        viewportKnown = false;
+        capabilities.clear();
+    }
+
+    // closes the frame's counts
+    void endFrame()
+    {
+        frames++;
+    }
+
+    // print the calls issued and elided per frame since the last reset and start counting again
+    void report()
+    {
+        double perFrame = frames > 0 ? 1.0 / frames : 0.0;
+        std::cout << "GL state: " << elided * perFrame << " redundant calls elided, " << issued * perFrame
+                  << " issued per frame (avg of " << frames << " frames)" << std::endl;
+        issued = elided = 0;
+        frames = 0;
+    }
+
+    GLState(const GLState &) = delete;
+    GLState &operator=(const GLState &) = delete;
+
+private:
+    // no object has this name, so the first call of each kind is always issued
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+    GLuint currentProgram = UNKNOWN;
+    GLuint currentVertexArray = UNKNOWN;
+    GLuint currentUnit = UNKNOWN;
+    GLuint currentFramebuffer = UNKNOWN;
+    std::vector<GLuint> boundTextures;
+    std::unordered_map<GLuint, std::vector<GLenum>> framebufferDrawBuffers;
+    bool viewportKnown = false;
+    GLint currentViewport[4] = {};
+    std::unordered_map<GLenum, bool> capabilities;
+    unsigned long long issued = 0, elided = 0;
+    int frames = 0;
+
+    GLState() {}
+
+    // counts the call, true if it can be skipped
+    bool elide(bool redundant)
+    {
+        if (redundant) {
+            elided++;
+        }
+        else {
+            issued++;
+        }
+        return redundant;
+    }
+};
+#endif
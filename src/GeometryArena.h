@@ -0,0 +1,292 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include "GLState.h"
+#include "Vertex.h"
+
+#include <algorithm>
+#include <vector>
+
+// layout glMultiDrawElementsIndirect reads from the draw indirect buffer
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Shared geometry storage for every mesh of one vertex format. Meshes are suballocated from one
+// large vertex buffer and one index buffer, so a single VAO describes all of them and a whole
+// model can be submitted with one multi draw. Freed ranges go on a free list and are handed out
+// again first fit, buffers grow by copying on the GPU when nothing fits.
+class GeometryArena
+{
+public:
+    // where a mesh lives in the arena
+    struct Range {
+        GLint baseVertex = 0;
+        GLuint firstIndex = 0;
+        GLuint vertexCount = 0;
+        GLuint indexCount = 0;
+    };
+
+    // the arena of a vertex format, created on first use (needs a current GL context)
+    static GeometryArena &forFormat(Vertex_Format format)
+    {
+        static GeometryArena full(VERTEX_FULL);
+        static GeometryArena packed(VERTEX_PACKED);
+        return format == VERTEX_PACKED ? packed : full;
+    }
+
+    // copies a mesh into the arena, packing its vertices if the arena's format asks for it.
+    // indices stay relative to the mesh's first vertex, draws add baseVertex
+    Range allocate(const Vertex *vertexData, size_t numVertices, const unsigned int *indexData, size_t numIndices)
+    {
+        Range range = reserve(numVertices, numIndices);
+        writeVertices(range.baseVertex, vertexData, numVertices);
+        writeIndices(range.firstIndex, indexData, numIndices);
+        return range;
+    }
+
+    // makes room for a mesh without filling it, for uploads spread over several writes
+    Range reserve(size_t numVertices, size_t numIndices)
+    {
+        size_t firstVertex = take(freeVertices, vertexUsed, numVertices);
+        size_t firstIndex = take(freeIndices, indexUsed, numIndices);
+        if (vertexUsed > vertexCapacity || indexUsed > indexCapacity) {
+            grow(std::max(vertexCapacity * 2, vertexUsed), std::max(indexCapacity * 2, indexUsed));
+        }
+
+        Range range;
+        range.baseVertex = (GLint)firstVertex;
+        range.firstIndex = (GLuint)firstIndex;
+        range.vertexCount = (GLuint)numVertices;
+        range.indexCount = (GLuint)numIndices;
+        return range;
+    }
+
+    // makes room for another index list over vertices reserved earlier (a level of detail), returns its first index
+    GLuint reserveIndices(size_t numIndices)
+    {
+        size_t firstIndex = take(freeIndices, indexUsed, numIndices);
+        if (indexUsed > indexCapacity) {
+            grow(vertexCapacity, std::max(indexCapacity * 2, indexUsed));
+        }
+        return (GLuint)firstIndex;
+    }
+
+    // fills reserved vertices starting at firstVertex, packing them if the arena's format asks for it
+    void writeVertices(size_t firstVertex, const Vertex *vertexData, size_t numVertices)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (format == VERTEX_PACKED) {
+            std::vector<PackedVertex> packed(numVertices);
+            for (size_t i = 0; i < numVertices; i++) {
+                packed[i] = packVertex(vertexData[i]);
+            }
+            glBufferSubData(GL_ARRAY_BUFFER, firstVertex * stride, numVertices * stride, packed.data());
+        }
+        else {
+            glBufferSubData(GL_ARRAY_BUFFER, firstVertex * stride, numVertices * stride, vertexData);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // fills reserved indices starting at firstIndex
+    void writeIndices(size_t firstIndex, const unsigned int *indexData, size_t numIndices)
+    {
+        // the element buffer is VAO state, bind it through the VAO
+        GLState::instance().bindVertexArray(VAO);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, firstIndex * sizeof(unsigned int), numIndices * sizeof(unsigned int), indexData);
+        GLState::instance().bindVertexArray(0);
+    }
+
+    // gives the vertices and indices of a range back to the arena. the buffers keep their size,
+    // later allocations reuse the room
+    void release(const Range &range)
+    {
+        give(freeVertices, vertexUsed, range.baseVertex, range.vertexCount);
+        give(freeIndices, indexUsed, range.firstIndex, range.indexCount);
+    }
+
+    // gives back an index list from reserveIndices
+    void releaseIndices(GLuint firstIndex, size_t numIndices)
+    {
+        give(freeIndices, indexUsed, firstIndex, numIndices);
+    }
+
+    // creates the skin cache, one SkinnedVertex for every vertex of the arena, see Mesh::Skin
+    void enableSkinCache()
+    {
+        if (skinnedVBO == 0) {
+            glGenBuffers(1, &skinnedVBO);
+            glGenVertexArrays(1, &skinnedVAO);
+            setupSkinCache();
+        }
+    }
+
+    unsigned int vao() const { return VAO; }
+    unsigned int skinnedVao() const { return skinnedVAO; }
+    unsigned int skinnedBuffer() const { return skinnedVBO; }
+
+    // issues count commands starting at first. with GL 4.3 they come from the bound draw indirect buffer
+    // in one call, older contexts (macOS) loop over the CPU copy instead
+    static void multiDraw(const std::vector<DrawElementsIndirectCommand> &commands, size_t first, size_t count)
+    {
+        if (GLAD_GL_VERSION_4_3) {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(first * sizeof(DrawElementsIndirectCommand)), (GLsizei)count, 0);
+            return;
+        }
+        for (size_t i = first; i < first + count; i++) {
+            const DrawElementsIndirectCommand &command = commands[i];
+            glDrawElementsBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+                                     (void*)(command.firstIndex * sizeof(unsigned int)), command.baseVertex);
+        }
+    }
+
+    GeometryArena(const GeometryArena &) = delete;
+    GeometryArena &operator=(const GeometryArena &) = delete;
+
+private:
+    Vertex_Format format;
+    size_t stride;
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    unsigned int skinnedVBO = 0, skinnedVAO = 0;
+    size_t vertexCapacity = 0, indexCapacity = 0;
+    // vertexUsed and indexUsed are where the never used tail of the buffers starts
+    size_t vertexUsed = 0, indexUsed = 0;
+    // released spans below that, sorted by first element and never touching each other
+    struct Span {
+        size_t first;
+        size_t count;
+    };
+    std::vector<Span> freeVertices, freeIndices;
+
+    GeometryArena(Vertex_Format format) : format(format)
+    {
+        stride = format == VERTEX_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+        glGenVertexArrays(1, &VAO);
+        // room for the dragon a few times over before the first grow
+        grow(64 * 1024, 256 * 1024);
+    }
+
+    // first fit from the free spans, the tail otherwise. moves used past the capacity when the
+    // buffers need to grow
+    static size_t take(std::vector<Span> &spans, size_t &used, size_t count)
+    {
+        for (size_t i = 0; i < spans.size(); i++) {
+            if (spans[i].count >= count) {
+                size_t first = spans[i].first;
+                spans[i].first += count;
+                spans[i].count -= count;
+                if (spans[i].count == 0) {
+                    spans.erase(spans.begin() + i);
+                }
+                return first;
+            }
+        }
+        size_t first = used;
+        used += count;
+        return first;
+    }
+
+    // puts a span back, merging it with its neighbours. a span reaching the tail shrinks used instead
+    static void give(std::vector<Span> &spans, size_t &used, size_t first, size_t count)
+    {
+        if (count == 0) {
+            return;
+        }
+        auto next = std::lower_bound(spans.begin(), spans.end(), first,
+                                     [](const Span &span, size_t value) { return span.first < value; });
+        next = spans.insert(next, Span{first, count});
+        if (next + 1 != spans.end() && next->first + next->count == (next + 1)->first) {
+            next->count += (next + 1)->count;
+            spans.erase(next + 1);
+        }
+        if (next != spans.begin() && (next - 1)->first + (next - 1)->count == next->first) {
+            (next - 1)->count += next->count;
+            next = spans.erase(next) - 1;
+        }
+        if (next->first + next->count == used) {
+            used = next->first;
+            spans.erase(next);
+        }
+    }
+
+    // moves the arena into larger buffers, keeping every allocation at its offset. used may already
+    // count the allocation that needs the room, only what fits the old buffers is copied
+    void grow(size_t vertices, size_t indices)
+    {
+        size_t vertexCopy = std::min(vertexUsed, vertexCapacity);
+        size_t indexCopy = std::min(indexUsed, indexCapacity);
+        unsigned int newVBO, newEBO;
+        glGenBuffers(1, &newVBO);
+        glGenBuffers(1, &newEBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, vertices * stride, NULL, GL_STATIC_DRAW);
+        if (vertexCopy > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, VBO);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, vertexCopy * stride);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newEBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, indices * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+        if (indexCopy > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, EBO);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, indexCopy * sizeof(unsigned int));
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if (VBO) glDeleteBuffers(1, &VBO);
+        if (EBO) glDeleteBuffers(1, &EBO);
+        VBO = newVBO;
+        EBO = newEBO;
+        vertexCapacity = vertices;
+        indexCapacity = indices;
+
+        // point the VAO at the new buffers
+        GLState::instance().bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        setupVertexAttributes(format);
+        GLState::instance().bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        if (skinnedVBO != 0) {
+            setupSkinCache();
+        }
+    }
+
+    // sizes the skin cache to the arena and sets up a VAO reading skinned positions and TBN from it,
+    // texture coords from the arena's vertices and indices from its element buffer.
+    // the cache is rewritten every frame, so growing it drops the old contents
+    void setupSkinCache()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, skinnedVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(SkinnedVertex), NULL, GL_DYNAMIC_COPY);
+
+        GLState::instance().bindVertexArray(skinnedVAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        // skinned positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Position));
+        // skinned normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Normal));
+        // skinned tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Tangent));
+        // skinned bitangent
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Bitangent));
+        // texture coords don't change with the pose, read them from the arena
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        setupTexCoordAttribute(format);
+
+        GLState::instance().bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+#endif
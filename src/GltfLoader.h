@@ -0,0 +1,349 @@
+#ifndef GLTF_LOADER_H
+#define GLTF_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include "Json.h"
+#include "BakedModel.h"
+#include "Vertex.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Reading glTF 2.0 files (.gltf with external .bin buffers) without assimp. The JSON is parsed once,
+// the buffers are mapped read only and accessors hand out typed views straight into the mappings, so
+// Model::loadGltf converts vertices from the file into its staged meshes in a single pass.
+// Embedded (data: URI) buffers, .glb containers and sparse accessors are not supported, Model falls
+// back to assimp for those.
+namespace gltf {
+
+    // accessor component types
+    const int COMPONENT_BYTE = 5120;
+    const int COMPONENT_UNSIGNED_BYTE = 5121;
+    const int COMPONENT_SHORT = 5122;
+    const int COMPONENT_UNSIGNED_SHORT = 5123;
+    const int COMPONENT_UNSIGNED_INT = 5125;
+    const int COMPONENT_FLOAT = 5126;
+    // primitive mode of triangle lists, the default
+    const int MODE_TRIANGLES = 4;
+    // accessor times are in seconds, the keys of Bone are in the milliseconds assimp converts them to
+    const double TICKS_PER_SECOND = 1000.0;
+
+    inline size_t componentSize(int componentType)
+    {
+        switch (componentType) {
+            case COMPONENT_BYTE:
+            case COMPONENT_UNSIGNED_BYTE:
+                return 1;
+            case COMPONENT_SHORT:
+            case COMPONENT_UNSIGNED_SHORT:
+                return 2;
+            case COMPONENT_UNSIGNED_INT:
+            case COMPONENT_FLOAT:
+                return 4;
+            default:
+                return 0;
+        }
+    }
+
+    inline int componentCount(const std::string &type)
+    {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        if (type == "MAT4") return 16;
+        return 0;
+    }
+
+    // typed view of an accessor inside a mapped buffer
+    struct Accessor {
+        const unsigned char *data = nullptr;
+        size_t count = 0;
+        size_t stride = 0;
+        int componentType = COMPONENT_FLOAT;
+        int components = 0;
+        bool normalized = false;
+
+        bool valid() const { return data != nullptr; }
+
+        // component c of element i. normalized integers map to [0, 1] or [-1, 1] as the spec says
+        float get(size_t i, int c) const
+        {
+            const unsigned char *p = data + i * stride;
+            switch (componentType) {
+                case COMPONENT_FLOAT: {
+                    float value;
+                    memcpy(&value, p + c * 4, 4);
+                    return value;
+                }
+                case COMPONENT_UNSIGNED_BYTE:
+                    return normalized ? p[c] / 255.0f : (float)p[c];
+                case COMPONENT_BYTE:
+                    return normalized ? std::max(((const int8_t *)p)[c] / 127.0f, -1.0f) : (float)((const int8_t *)p)[c];
+                case COMPONENT_UNSIGNED_SHORT: {
+                    uint16_t value;
+                    memcpy(&value, p + c * 2, 2);
+                    return normalized ? value / 65535.0f : (float)value;
+                }
+                case COMPONENT_SHORT: {
+                    int16_t value;
+                    memcpy(&value, p + c * 2, 2);
+                    return normalized ? std::max(value / 32767.0f, -1.0f) : (float)value;
+                }
+                case COMPONENT_UNSIGNED_INT: {
+                    uint32_t value;
+                    memcpy(&value, p + c * 4, 4);
+                    return (float)value;
+                }
+                default:
+                    return 0.0f;
+            }
+        }
+
+        // component c of element i of an integer accessor, such as indices or joints
+        unsigned int index(size_t i, int c = 0) const
+        {
+            const unsigned char *p = data + i * stride;
+            switch (componentType) {
+                case COMPONENT_UNSIGNED_BYTE:
+                    return p[c];
+                case COMPONENT_UNSIGNED_SHORT: {
+                    uint16_t value;
+                    memcpy(&value, p + c * 2, 2);
+                    return value;
+                }
+                case COMPONENT_UNSIGNED_INT: {
+                    uint32_t value;
+                    memcpy(&value, p + c * 4, 4);
+                    return value;
+                }
+                default:
+                    return (unsigned int)get(i, c);
+            }
+        }
+
+        glm::vec2 vec2(size_t i) const
+        {
+            return glm::vec2(get(i, 0), get(i, 1));
+        }
+
+        glm::vec3 vec3(size_t i) const
+        {
+            return glm::vec3(get(i, 0), get(i, 1), get(i, 2));
+        }
+
+        glm::vec4 vec4(size_t i) const
+        {
+            return glm::vec4(get(i, 0), get(i, 1), get(i, 2), get(i, 3));
+        }
+
+        // a MAT4 element, column major like glm
+        glm::mat4 mat4(size_t i) const
+        {
+            glm::mat4 m;
+            for (int c = 0; c < 16; c++) {
+                m[c / 4][c % 4] = get(i, c);
+            }
+            return m;
+        }
+    };
+
+    // a parsed .gltf and its mapped buffers
+    class Document
+    {
+    public:
+        // directory the file is in, buffer and image URIs are relative to it
+        std::string directory;
+
+        // parses path and maps its buffers. false, with the reason printed, if either fails
+        bool open(std::string const &path)
+        {
+            std::ifstream file(path, std::ios::binary);
+            if (!file) {
+                std::cout << "ERROR::GLTF:: could not open " << path << std::endl;
+                return false;
+            }
+            std::stringstream contents;
+            contents << file.rdbuf();
+            std::string text = contents.str();
+            std::string error;
+            if (!json::parse(text.data(), text.size(), document, &error)) {
+                std::cout << "ERROR::GLTF:: " << path << " is not valid JSON: " << error << std::endl;
+                return false;
+            }
+            if (document["asset"]["version"].asString().compare(0, 1, "2") != 0) {
+                std::cout << "ERROR::GLTF:: " << path << " is not glTF 2.0" << std::endl;
+                return false;
+            }
+            size_t slash = path.find_last_of('/');
+            directory = slash == std::string::npos ? "." : path.substr(0, slash);
+
+            const json::Value &bufferList = document["buffers"];
+            for (size_t i = 0; i < bufferList.size(); i++) {
+                const std::string &uri = bufferList[i]["uri"].asString();
+                if (uri.empty() || uri.compare(0, 5, "data:") == 0) {
+                    std::cout << "ERROR::GLTF:: " << path << " has an embedded buffer, only external .bin files are read" << std::endl;
+                    return false;
+                }
+                buffers.emplace_back(new baked::MappedFile(directory + '/' + decodeUri(uri)));
+                if (!buffers.back()->data() || buffers.back()->length() < (size_t)bufferList[i]["byteLength"].asNumber()) {
+                    std::cout << "ERROR::GLTF:: could not map buffer " << uri << " of " << path << std::endl;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        const json::Value &root() const
+        {
+            return document;
+        }
+
+        // view of accessor index, invalid if it is missing, sparse or doesn't fit its buffer
+        Accessor accessor(int index) const
+        {
+            Accessor view;
+            const json::Value &accessor = document["accessors"][index];
+            const json::Value &bufferView = document["bufferViews"][accessor["bufferView"].asInt()];
+            int buffer = bufferView["buffer"].asInt();
+            if (!accessor.isObject() || !bufferView.isObject() || accessor.has("sparse") || buffer < 0 || buffer >= (int)buffers.size()) {
+                return view;
+            }
+            view.componentType = accessor["componentType"].asInt();
+            view.components = componentCount(accessor["type"].asString());
+            view.normalized = accessor["normalized"].asBool();
+            view.count = (size_t)accessor["count"].asNumber();
+            size_t elementSize = componentSize(view.componentType) * view.components;
+            view.stride = bufferView.has("byteStride") ? (size_t)bufferView["byteStride"].asNumber() : elementSize;
+            size_t offset = (size_t)bufferView["byteOffset"].asNumber() + (size_t)accessor["byteOffset"].asNumber();
+            size_t viewEnd = (size_t)bufferView["byteOffset"].asNumber() + (size_t)bufferView["byteLength"].asNumber();
+            if (elementSize == 0 || viewEnd > buffers[buffer]->length() ||
+                (view.count > 0 && offset + (view.count - 1) * view.stride + elementSize > viewEnd)) {
+                return view;
+            }
+            view.data = buffers[buffer]->data() + offset;
+            return view;
+        }
+
+        // file the image of texture index refers to, relative to directory. empty if there is none
+        std::string texturePath(int index) const
+        {
+            const json::Value &texture = document["textures"][index];
+            const std::string &uri = document["images"][texture["source"].asInt()]["uri"].asString();
+            return uri.compare(0, 5, "data:") == 0 ? std::string() : decodeUri(uri);
+        }
+
+        // undoes the percent encoding of a relative URI
+        static std::string decodeUri(std::string const &uri)
+        {
+            std::string path;
+            path.reserve(uri.size());
+            for (size_t i = 0; i < uri.size(); i++) {
+                if (uri[i] == '%' && i + 2 < uri.size() && isxdigit((unsigned char)uri[i + 1]) && isxdigit((unsigned char)uri[i + 2])) {
+                    path += (char)strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+                    i += 2;
+                }
+                else {
+                    path += uri[i];
+                }
+            }
+            return path;
+        }
+
+    private:
+        json::Value document;
+        std::vector<std::unique_ptr<baked::MappedFile>> buffers;
+    };
+
+    // per vertex tangents and bitangents from the UV layout, for meshes that ship without TANGENT.
+    // triangles are split across threads, then vertices, so neither pass needs locks
+    inline void generateTangents(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+        unsigned int threadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), (unsigned int)(triangleCount / 4096 + 1)));
+        auto parallel = [threadCount](size_t count, const std::function<void(size_t, size_t)> &work) {
+            std::vector<std::thread> threads;
+            size_t chunk = (count + threadCount - 1) / threadCount;
+            for (unsigned int t = 1; t < threadCount; t++) {
+                size_t first = std::min(count, t * chunk);
+                threads.push_back(std::thread(work, first, std::min(count, first + chunk)));
+            }
+            work(0, std::min(count, chunk));
+            for (size_t t = 0; t < threads.size(); t++) {
+                threads[t].join();
+            }
+        };
+
+        // area weighted tangent and bitangent of every triangle
+        std::vector<glm::vec3> faceTangents(triangleCount), faceBitangents(triangleCount);
+        parallel(triangleCount, [&](size_t first, size_t last) {
+            for (size_t t = first; t < last; t++) {
+                const Vertex &v0 = vertices[indices[t * 3]];
+                const Vertex &v1 = vertices[indices[t * 3 + 1]];
+                const Vertex &v2 = vertices[indices[t * 3 + 2]];
+                glm::vec3 e1 = v1.Position - v0.Position, e2 = v2.Position - v0.Position;
+                glm::vec2 d1 = v1.TexCoords - v0.TexCoords, d2 = v2.TexCoords - v0.TexCoords;
+                float determinant = d1.x * d2.y - d2.x * d1.y;
+                if (fabsf(determinant) < 1e-12f) {
+                    continue;
+                }
+                float r = 1.0f / determinant;
+                faceTangents[t] = (e1 * d2.y - e2 * d1.y) * r;
+                faceBitangents[t] = (e2 * d1.x - e1 * d2.x) * r;
+            }
+        });
+
+        // triangles around each vertex
+        std::vector<unsigned int> adjacencyStart(vertices.size() + 1, 0);
+        for (size_t i = 0; i < indices.size(); i++) {
+            adjacencyStart[indices[i] + 1]++;
+        }
+        for (size_t v = 0; v < vertices.size(); v++) {
+            adjacencyStart[v + 1] += adjacencyStart[v];
+        }
+        std::vector<unsigned int> adjacency(indices.size());
+        std::vector<unsigned int> cursor(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            adjacency[cursor[indices[i]]++] = (unsigned int)(i / 3);
+        }
+
+        // sum them per vertex and make the tangent orthogonal to the normal
+        parallel(vertices.size(), [&](size_t first, size_t last) {
+            for (size_t v = first; v < last; v++) {
+                glm::vec3 tangent(0.0f), bitangent(0.0f);
+                for (unsigned int a = adjacencyStart[v]; a < adjacencyStart[v + 1]; a++) {
+                    tangent += faceTangents[adjacency[a]];
+                    bitangent += faceBitangents[adjacency[a]];
+                }
+                Vertex &vertex = vertices[v];
+                tangent -= vertex.Normal * glm::dot(vertex.Normal, tangent);
+                float length = glm::length(tangent);
+                if (length < 1e-12f) {
+                    // no usable UVs, any direction across the normal will do
+                    glm::vec3 axis = fabsf(vertex.Normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+                    tangent = glm::cross(vertex.Normal, axis);
+                    length = glm::length(tangent);
+                }
+                vertex.Tangent = length > 0.0f ? tangent / length : tangent;
+                float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+                vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent) * handedness;
+            }
+        });
+    }
+}
+#endif
@@ -0,0 +1,71 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <iostream>
+
+// Measures the GPU time spent between begin() and end() with GL_TIME_ELAPSED queries.
+// Results are read back a few frames late so that timing never stalls the pipeline.
+// Timers can't be nested, only one may be between begin() and end() at a time.
+class GpuTimer
+{
+public:
+    std::string name;
+
+    GpuTimer(std::string const &name) : name(name)
+    {
+        glGenQueries(QUERY_COUNT, queries);
+    }
+
+    ~GpuTimer()
+    {
+        glDeleteQueries(QUERY_COUNT, queries);
+    }
+
+    void begin()
+    {
+        glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[current] = true;
+        current = (current + 1) % QUERY_COUNT;
+        // the next query to reuse is the oldest one, it has had QUERY_COUNT - 1 frames to finish
+        if (pending[current]) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queries[current], GL_QUERY_RESULT, &elapsed);
+            pending[current] = false;
+            totalMs += elapsed / 1.0e6;
+            samples++;
+        }
+    }
+
+    double averageMs() const
+    {
+        return samples > 0 ? totalMs / samples : 0.0;
+    }
+
+    // print the average since the last reset and start averaging again
+    void report()
+    {
+        std::cout << name << ": " << averageMs() << " ms (avg of " << samples << " frames)" << std::endl;
+        totalMs = 0.0;
+        samples = 0;
+    }
+
+    GpuTimer(const GpuTimer &) = delete;
+    GpuTimer &operator=(const GpuTimer &) = delete;
+
+private:
+    static const int QUERY_COUNT = 4;
+    GLuint queries[QUERY_COUNT];
+    bool pending[QUERY_COUNT] = {false};
+    int current = 0;
+    double totalMs = 0.0;
+    int samples = 0;
+};
+#endif
@@ -0,0 +1,269 @@
+#ifndef INDEX_OPTIMIZER_H
+#define INDEX_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include "Vertex.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+// Reorders a mesh for the GPU at import: triangles for the post-transform vertex cache (Forsyth's
+// linear speed algorithm), clusters of them so outward facing ones draw first and cut overdraw
+// (after Sander et al.), and vertices in the order the triangles first use them so vertex fetch
+// reads memory sequentially. None of it changes what the mesh looks like.
+namespace index_optimizer {
+
+    // size of the LRU cache the ordering is tuned for, larger than real FIFO caches so it works across hardware
+    const int CACHE_SIZE = 32;
+    // FIFO cache size ACMR is reported for
+    const int REPORT_CACHE_SIZE = 16;
+
+    // vertex shader invocations a FIFO cache of cacheSize entries needs for the index list
+    inline size_t cacheMisses(const unsigned int *indices, size_t indexCount, size_t vertexCount, int cacheSize = REPORT_CACHE_SIZE) {
+        // the time a vertex entered the cache, it is still in it while fewer than cacheSize misses happened since
+        std::vector<size_t> entered(vertexCount, 0);
+        size_t misses = 0;
+        for (size_t i = 0; i < indexCount; i++) {
+            unsigned int v = indices[i];
+            if (entered[v] == 0 || misses - entered[v] >= (size_t)cacheSize) {
+                misses++;
+                entered[v] = misses;
+            }
+        }
+        return misses;
+    }
+
+    // average cache miss ratio, vertex shader invocations per triangle. 0.5 is the ideal for a large grid, 3 the worst
+    inline float acmr(const unsigned int *indices, size_t indexCount, size_t vertexCount, int cacheSize = REPORT_CACHE_SIZE) {
+        return indexCount < 3 ? 0.0f : (float)cacheMisses(indices, indexCount, vertexCount, cacheSize) / (indexCount / 3);
+    }
+
+    // Forsyth's vertex score: recently used vertices score high, as do vertices with few triangles left
+    inline float vertexScore(int cachePosition, unsigned int remaining) {
+        if (remaining == 0) {
+            return -1.0f;
+        }
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            // the three vertices of the last triangle get a fixed score so the next one doesn't just reuse its edge
+            score = cachePosition < 3 ? 0.75f : powf(1.0f - (float)(cachePosition - 3) / (CACHE_SIZE - 3), 1.5f);
+        }
+        return score + 2.0f / sqrtf((float)remaining);
+    }
+
+    // reorders the triangles of indices in place for the post-transform vertex cache, indices is a triangle list
+    inline void optimizeVertexCache(unsigned int *indices, size_t indexCount, size_t vertexCount) {
+        assert(indexCount % 3 == 0);
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        // triangles around each vertex, the first remaining[v] of them not emitted yet
+        std::vector<unsigned int> remaining(vertexCount, 0);
+        for (size_t i = 0; i < indexCount; i++) {
+            remaining[indices[i]]++;
+        }
+        std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++) {
+            adjacencyStart[v + 1] = adjacencyStart[v] + remaining[v];
+        }
+        std::vector<unsigned int> adjacency(indexCount);
+        std::vector<unsigned int> cursor(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t i = 0; i < indexCount; i++) {
+            adjacency[cursor[indices[i]]++] = (unsigned int)(i / 3);
+        }
+
+        std::vector<float> score(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++) {
+            score[v] = vertexScore(-1, remaining[v]);
+        }
+        std::vector<float> triangleScore(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++) {
+            triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+        }
+
+        std::vector<unsigned int> result;
+        result.reserve(indexCount);
+        std::vector<unsigned char> emitted(triangleCount, 0);
+        std::vector<unsigned int> cache, nextCache;
+        cache.reserve(CACHE_SIZE + 3);
+        nextCache.reserve(CACHE_SIZE + 3);
+        size_t scan = 0;
+        long best = -1;
+
+        while (result.size() < indexCount) {
+            if (best < 0) {
+                // nothing in the cache has triangles left, continue with the next one in input order
+                while (emitted[scan]) {
+                    scan++;
+                }
+                best = (long)scan;
+            }
+            const unsigned int *tri = &indices[best * 3];
+            emitted[best] = 1;
+            result.insert(result.end(), tri, tri + 3);
+
+            // take the triangle off its vertices' lists
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = tri[k];
+                unsigned int *list = &adjacency[adjacencyStart[v]];
+                for (unsigned int a = 0; a < remaining[v]; a++) {
+                    if (list[a] == (unsigned int)best) {
+                        std::swap(list[a], list[remaining[v] - 1]);
+                        break;
+                    }
+                }
+                remaining[v]--;
+            }
+
+            // its vertices go to the front of the cache, the rest shift back
+            nextCache.assign(tri, tri + 3);
+            for (size_t i = 0; i < cache.size(); i++) {
+                if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2]) {
+                    nextCache.push_back(cache[i]);
+                }
+            }
+            for (size_t i = CACHE_SIZE; i < nextCache.size(); i++) {
+                // fell out of the cache
+                score[nextCache[i]] = vertexScore(-1, remaining[nextCache[i]]);
+            }
+            if (nextCache.size() > (size_t)CACHE_SIZE) {
+                nextCache.resize(CACHE_SIZE);
+            }
+            cache.swap(nextCache);
+
+            // rescore the cached vertices and the triangles they still have, the best of those goes next
+            for (size_t i = 0; i < cache.size(); i++) {
+                score[cache[i]] = vertexScore((int)i, remaining[cache[i]]);
+            }
+            best = -1;
+            float bestScore = 0.0f;
+            for (size_t i = 0; i < cache.size(); i++) {
+                unsigned int v = cache[i];
+                for (unsigned int a = 0; a < remaining[v]; a++) {
+                    unsigned int t = adjacency[adjacencyStart[v] + a];
+                    triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                    if (triangleScore[t] > bestScore) {
+                        bestScore = triangleScore[t];
+                        best = (long)t;
+                    }
+                }
+            }
+        }
+        std::copy(result.begin(), result.end(), indices);
+    }
+
+    // Reorders clusters of a cache optimized index list so those facing away from the mesh's centre, which
+    // tend to hide the rest, are drawn first. Clusters end where the cache starts over anyway, or where
+    // breaking the list keeps its ACMR within threshold of the original, so the cache order survives.
+    inline void optimizeOverdraw(unsigned int *indices, size_t indexCount, const Vertex *vertices, size_t vertexCount, float threshold = 1.05f) {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount < 2) {
+            return;
+        }
+        float limit = acmr(indices, indexCount, vertexCount) * threshold;
+
+        // split into clusters. the cache is simulated twice: across the whole list to find where it starts over,
+        // and from cold for the current cluster, which is what the cluster costs once it has moved
+        std::vector<size_t> clusterStart(1, 0);
+        std::vector<size_t> entered(vertexCount, 0), coldEntered(vertexCount, 0), coldCluster(vertexCount, 0);
+        size_t misses = 0, coldMisses = 0, clusterMisses = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            size_t triangleMisses = 0;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[t * 3 + k];
+                if (entered[v] == 0 || misses - entered[v] >= (size_t)REPORT_CACHE_SIZE) {
+                    misses++;
+                    triangleMisses++;
+                    entered[v] = misses;
+                }
+            }
+            size_t clusterTriangles = t - clusterStart.back();
+            // all three missed: the cache has started over anyway, or the cluster on its own is about as good as the whole list
+            bool hardBoundary = triangleMisses == 3;
+            bool softBoundary = clusterTriangles >= 16 && (float)clusterMisses / clusterTriangles <= limit;
+            if (t > 0 && (hardBoundary || softBoundary)) {
+                clusterStart.push_back(t);
+                clusterMisses = 0;
+            }
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[t * 3 + k];
+                if (coldCluster[v] != clusterStart.size() || coldMisses - coldEntered[v] >= (size_t)REPORT_CACHE_SIZE) {
+                    coldMisses++;
+                    clusterMisses++;
+                    coldEntered[v] = coldMisses;
+                    coldCluster[v] = clusterStart.size();
+                }
+            }
+        }
+        clusterStart.push_back(triangleCount);
+        size_t clusterCount = clusterStart.size() - 1;
+
+        // area weighted centroid and normal of each cluster and of the mesh
+        std::vector<glm::vec3> centroid(clusterCount), normal(clusterCount);
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (size_t c = 0; c < clusterCount; c++) {
+            glm::vec3 sum(0.0f), normalSum(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++) {
+                const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+                const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                float a = glm::length(n);
+                sum += (p0 + p1 + p2) * (a / 3.0f);
+                normalSum += n;
+                area += a;
+            }
+            centroid[c] = area > 0.0f ? sum / area : vertices[indices[clusterStart[c] * 3]].Position;
+            float length = glm::length(normalSum);
+            normal[c] = length > 0.0f ? normalSum / length : glm::vec3(0.0f);
+            meshCentroid += sum;
+            meshArea += area;
+        }
+        if (meshArea > 0.0f) {
+            meshCentroid /= meshArea;
+        }
+
+        // most outward facing first
+        std::vector<float> key(clusterCount);
+        std::vector<size_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) {
+            key[c] = glm::dot(centroid[c] - meshCentroid, normal[c]);
+            order[c] = c;
+        }
+        std::stable_sort(order.begin(), order.end(), [&key](size_t a, size_t b) { return key[a] > key[b]; });
+
+        std::vector<unsigned int> result;
+        result.reserve(indexCount);
+        for (size_t i = 0; i < clusterCount; i++) {
+            size_t c = order[i];
+            result.insert(result.end(), indices + clusterStart[c] * 3, indices + clusterStart[c + 1] * 3);
+        }
+        std::copy(result.begin(), result.end(), indices);
+    }
+
+    // reorders vertices into the order the index list first uses them and rewrites the indices to match.
+    // vertices no triangle uses are dropped
+    inline void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+        const unsigned int unused = ~0u;
+        std::vector<unsigned int> remap(vertices.size(), unused);
+        std::vector<Vertex> ordered;
+        ordered.reserve(vertices.size());
+        for (size_t i = 0; i < indices.size(); i++) {
+            unsigned int &index = indices[i];
+            if (remap[index] == unused) {
+                remap[index] = (unsigned int)ordered.size();
+                ordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(ordered);
+    }
+}
+#endif
@@ -0,0 +1,379 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Small JSON reader for asset files (glTF). The whole text is parsed once into a tree of Values;
+// lookups of missing members or elements return a null Value, so optional fields can be read
+// without checking each level first.
+namespace json {
+
+    enum Type {
+        JSON_NULL,
+        JSON_BOOL,
+        JSON_NUMBER,
+        JSON_STRING,
+        JSON_ARRAY,
+        JSON_OBJECT
+    };
+
+    class Value
+    {
+    public:
+        Type type = JSON_NULL;
+        bool boolean = false;
+        double number = 0.0;
+        std::string text;
+        std::vector<Value> items;
+        // members in file order, objects in asset files are small enough to search linearly
+        std::vector<std::pair<std::string, Value>> members;
+
+        bool isNull() const { return type == JSON_NULL; }
+        bool isNumber() const { return type == JSON_NUMBER; }
+        bool isString() const { return type == JSON_STRING; }
+        bool isArray() const { return type == JSON_ARRAY; }
+        bool isObject() const { return type == JSON_OBJECT; }
+
+        // elements of an array, members of an object, 0 otherwise
+        size_t size() const
+        {
+            return type == JSON_ARRAY ? items.size() : type == JSON_OBJECT ? members.size() : 0;
+        }
+
+        const Value &operator[](size_t index) const
+        {
+            return type == JSON_ARRAY && index < items.size() ? items[index] : null();
+        }
+
+        const Value &operator[](int index) const
+        {
+            return index < 0 ? null() : (*this)[(size_t)index];
+        }
+
+        const Value &operator[](const char *key) const
+        {
+            if (type == JSON_OBJECT) {
+                for (size_t i = 0; i < members.size(); i++) {
+                    if (members[i].first == key) {
+                        return members[i].second;
+                    }
+                }
+            }
+            return null();
+        }
+
+        bool has(const char *key) const
+        {
+            return !(*this)[key].isNull();
+        }
+
+        double asNumber(double fallback = 0.0) const
+        {
+            return type == JSON_NUMBER ? number : fallback;
+        }
+
+        int asInt(int fallback = -1) const
+        {
+            return type == JSON_NUMBER ? (int)number : fallback;
+        }
+
+        bool asBool(bool fallback = false) const
+        {
+            return type == JSON_BOOL ? boolean : fallback;
+        }
+
+        const std::string &asString() const
+        {
+            return type == JSON_STRING ? text : null().text;
+        }
+
+        // what lookups that find nothing return
+        static const Value &null()
+        {
+            static const Value value;
+            return value;
+        }
+    };
+
+    // recursive descent over a NUL terminated text
+    class Parser
+    {
+    public:
+        Parser(const char *text, const char *end) : start(text), cursor(text), end(end) {}
+
+        bool parse(Value &out, std::string *error)
+        {
+            out = Value();
+            skipSpace();
+            bool ok = parseValue(out, 0);
+            skipSpace();
+            if (ok && cursor != end) {
+                ok = fail("trailing characters");
+            }
+            if (!ok && error) {
+                *error = message + " at offset " + std::to_string(offset);
+            }
+            return ok;
+        }
+
+    private:
+        // deeper nesting than this is refused rather than risking the stack
+        static const int MAX_DEPTH = 256;
+        const char *start;
+        const char *cursor;
+        const char *end;
+        std::string message;
+        size_t offset = 0;
+
+        bool fail(const char *what)
+        {
+            if (message.empty()) {
+                message = what;
+                offset = (size_t)(cursor - start);
+            }
+            return false;
+        }
+
+        void skipSpace()
+        {
+            while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r')) {
+                cursor++;
+            }
+        }
+
+        bool literal(const char *word)
+        {
+            size_t length = strlen(word);
+            if ((size_t)(end - cursor) < length || strncmp(cursor, word, length) != 0) {
+                return fail("unexpected character");
+            }
+            cursor += length;
+            return true;
+        }
+
+        bool parseValue(Value &out, int depth)
+        {
+            if (depth > MAX_DEPTH) {
+                return fail("nested too deeply");
+            }
+            if (cursor >= end) {
+                return fail("unexpected end");
+            }
+            switch (*cursor) {
+                case '{':
+                    return parseObject(out, depth);
+                case '[':
+                    return parseArray(out, depth);
+                case '"':
+                    out.type = JSON_STRING;
+                    return parseString(out.text);
+                case 't':
+                    out.type = JSON_BOOL;
+                    out.boolean = true;
+                    return literal("true");
+                case 'f':
+                    out.type = JSON_BOOL;
+                    out.boolean = false;
+                    return literal("false");
+                case 'n':
+                    out.type = JSON_NULL;
+                    return literal("null");
+                default:
+                    return parseNumber(out);
+            }
+        }
+
+        bool parseNumber(Value &out)
+        {
+            char *numberEnd = nullptr;
+            out.number = strtod(cursor, &numberEnd);
+            if (numberEnd == cursor || numberEnd > end) {
+                return fail("expected a value");
+            }
+            out.type = JSON_NUMBER;
+            cursor = numberEnd;
+            return true;
+        }
+
+        bool parseObject(Value &out, int depth)
+        {
+            out.type = JSON_OBJECT;
+            cursor++;
+            skipSpace();
+            if (cursor < end && *cursor == '}') {
+                cursor++;
+                return true;
+            }
+            for (;;) {
+                skipSpace();
+                if (cursor >= end || *cursor != '"') {
+                    return fail("expected a member name");
+                }
+                out.members.emplace_back();
+                if (!parseString(out.members.back().first)) {
+                    return false;
+                }
+                skipSpace();
+                if (cursor >= end || *cursor != ':') {
+                    return fail("expected ':'");
+                }
+                cursor++;
+                skipSpace();
+                if (!parseValue(out.members.back().second, depth + 1)) {
+                    return false;
+                }
+                skipSpace();
+                if (cursor < end && *cursor == ',') {
+                    cursor++;
+                    continue;
+                }
+                if (cursor < end && *cursor == '}') {
+                    cursor++;
+                    return true;
+                }
+                return fail("expected ',' or '}'");
+            }
+        }
+
+        bool parseArray(Value &out, int depth)
+        {
+            out.type = JSON_ARRAY;
+            cursor++;
+            skipSpace();
+            if (cursor < end && *cursor == ']') {
+                cursor++;
+                return true;
+            }
+            for (;;) {
+                skipSpace();
+                out.items.emplace_back();
+                if (!parseValue(out.items.back(), depth + 1)) {
+                    return false;
+                }
+                skipSpace();
+                if (cursor < end && *cursor == ',') {
+                    cursor++;
+                    continue;
+                }
+                if (cursor < end && *cursor == ']') {
+                    cursor++;
+                    return true;
+                }
+                return fail("expected ',' or ']'");
+            }
+        }
+
+        static int hexDigit(char c)
+        {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
+
+        bool parseHex4(unsigned int &code)
+        {
+            if (end - cursor < 4) {
+                return fail("bad \\u escape");
+            }
+            code = 0;
+            for (int i = 0; i < 4; i++) {
+                int digit = hexDigit(cursor[i]);
+                if (digit < 0) {
+                    return fail("bad \\u escape");
+                }
+                code = code * 16 + digit;
+            }
+            cursor += 4;
+            return true;
+        }
+
+        static void appendUtf8(std::string &out, unsigned int code)
+        {
+            if (code < 0x80) {
+                out += (char)code;
+            }
+            else if (code < 0x800) {
+                out += (char)(0xC0 | (code >> 6));
+                out += (char)(0x80 | (code & 0x3F));
+            }
+            else if (code < 0x10000) {
+                out += (char)(0xE0 | (code >> 12));
+                out += (char)(0x80 | ((code >> 6) & 0x3F));
+                out += (char)(0x80 | (code & 0x3F));
+            }
+            else {
+                out += (char)(0xF0 | (code >> 18));
+                out += (char)(0x80 | ((code >> 12) & 0x3F));
+                out += (char)(0x80 | ((code >> 6) & 0x3F));
+                out += (char)(0x80 | (code & 0x3F));
+            }
+        }
+
+        bool parseString(std::string &out)
+        {
+            cursor++;
+            for (;;) {
+                // copy the run up to the next quote or escape in one go
+                const char *run = cursor;
+                while (cursor < end && *cursor != '"' && *cursor != '\\') {
+                    cursor++;
+                }
+                out.append(run, cursor - run);
+                if (cursor >= end) {
+                    return fail("unterminated string");
+                }
+                if (*cursor == '"') {
+                    cursor++;
+                    return true;
+                }
+                cursor++;
+                if (cursor >= end) {
+                    return fail("unterminated string");
+                }
+                char escape = *cursor++;
+                switch (escape) {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': {
+                        unsigned int code;
+                        if (!parseHex4(code)) {
+                            return false;
+                        }
+                        // a surrogate pair spells out one code point above the basic plane
+                        if (code >= 0xD800 && code < 0xDC00 && end - cursor >= 6 && cursor[0] == '\\' && cursor[1] == 'u') {
+                            cursor += 2;
+                            unsigned int low;
+                            if (!parseHex4(low)) {
+                                return false;
+                            }
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        appendUtf8(out, code);
+                        break;
+                    }
+                    default:
+                        return fail("bad escape");
+                }
+            }
+        }
+    };
+
+    // parses a whole document. text has to be NUL terminated at text + length (std::string data is)
+    inline bool parse(const char *text, size_t length, Value &out, std::string *error = nullptr)
+    {
+        Parser parser(text, text + length);
+        return parser.parse(out, error);
+    }
+}
+#endif
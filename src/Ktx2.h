@@ -0,0 +1,207 @@
+#ifndef KTX2_H
+#define KTX2_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Reading and writing the subset of KTX2 the texture baker produces: a single 2D image with a full
+// mip chain of BC1, BC3 or BC5 blocks, no supercompression. Files follow the Khronos spec (level
+// index, basic data format descriptor, mips stored smallest first) so other KTX2 tools can open them.
+namespace ktx2 {
+
+    const unsigned char IDENTIFIER[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+    // VkFormat values of the block compressed formats we bake
+    const uint32_t VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+    const uint32_t VK_FORMAT_BC3_UNORM_BLOCK = 137;
+    const uint32_t VK_FORMAT_BC5_UNORM_BLOCK = 141;
+
+    struct Header {
+        unsigned char identifier[12];
+        uint32_t vkFormat;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+        // index
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        uint64_t sgdByteOffset;
+        uint64_t sgdByteLength;
+    };
+
+    struct LevelIndex {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+
+    struct Level {
+        uint32_t width;
+        uint32_t height;
+        const unsigned char *data;
+        size_t size;
+    };
+
+    // a parsed file, levels point into the bytes it was parsed from
+    struct Image {
+        uint32_t vkFormat = 0;
+        std::vector<Level> levels;
+    };
+
+    // where the baked version of an image lives: the same path with a .ktx2 extension
+    inline std::string bakedPath(std::string const &imagePath) {
+        size_t dot = imagePath.find_last_of('.');
+        size_t slash = imagePath.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return imagePath + ".ktx2";
+        }
+        return imagePath.substr(0, dot) + ".ktx2";
+    }
+
+    // bytes per 4x4 block
+    inline uint32_t blockBytes(uint32_t vkFormat) {
+        return vkFormat == VK_FORMAT_BC1_RGB_UNORM_BLOCK ? 8 : 16;
+    }
+
+    inline size_t levelSize(uint32_t vkFormat, uint32_t width, uint32_t height) {
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(vkFormat);
+    }
+
+    inline bool parse(const unsigned char *data, size_t size, Image &out) {
+        if (size < sizeof(Header) || memcmp(data, IDENTIFIER, sizeof(IDENTIFIER)) != 0) {
+            return false;
+        }
+        Header header;
+        memcpy(&header, data, sizeof(Header));
+        if (header.vkFormat != VK_FORMAT_BC1_RGB_UNORM_BLOCK && header.vkFormat != VK_FORMAT_BC3_UNORM_BLOCK &&
+            header.vkFormat != VK_FORMAT_BC5_UNORM_BLOCK) {
+            std::cout << "ERROR::KTX2:: unsupported vkFormat " << header.vkFormat << std::endl;
+            return false;
+        }
+        if (header.supercompressionScheme != 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1) {
+            std::cout << "ERROR::KTX2:: only plain 2D textures are supported" << std::endl;
+            return false;
+        }
+        uint32_t levelCount = header.levelCount > 0 ? header.levelCount : 1;
+        if (sizeof(Header) + levelCount * sizeof(LevelIndex) > size) {
+            return false;
+        }
+
+        out.vkFormat = header.vkFormat;
+        out.levels.clear();
+        for (uint32_t i = 0; i < levelCount; i++) {
+            LevelIndex index;
+            memcpy(&index, data + sizeof(Header) + i * sizeof(LevelIndex), sizeof(LevelIndex));
+            Level level;
+            level.width = header.pixelWidth >> i ? header.pixelWidth >> i : 1;
+            level.height = header.pixelHeight >> i ? header.pixelHeight >> i : 1;
+            level.data = data + index.byteOffset;
+            level.size = (size_t)index.byteLength;
+            if (index.byteOffset + index.byteLength > size || level.size != levelSize(header.vkFormat, level.width, level.height)) {
+                std::cout << "ERROR::KTX2:: level " << i << " is truncated or has the wrong size" << std::endl;
+                return false;
+            }
+            out.levels.push_back(level);
+        }
+        return true;
+    }
+
+    // basic data format descriptor, one sample per 64 bit half of the block
+    inline std::vector<unsigned char> dataFormatDescriptor(uint32_t vkFormat) {
+        // KHR_DF_MODEL_BC1A / BC3 / BC5 and their channel ids
+        uint8_t colorModel = 128;
+        std::vector<uint8_t> channels(1, 0);
+        if (vkFormat == VK_FORMAT_BC3_UNORM_BLOCK) {
+            colorModel = 130;
+            channels = {15, 0};     // alpha block, then colour block
+        }
+        else if (vkFormat == VK_FORMAT_BC5_UNORM_BLOCK) {
+            colorModel = 132;
+            channels = {0, 1};      // red block, then green block
+        }
+
+        uint32_t blockSize = 24 + 16 * (uint32_t)channels.size();
+        std::vector<unsigned char> dfd(4 + blockSize, 0);
+        uint32_t totalSize = (uint32_t)dfd.size();
+        memcpy(&dfd[0], &totalSize, 4);
+        // vendorId 0, descriptorType 0, versionNumber 2
+        uint32_t versionAndSize = 2 | (blockSize << 16);
+        memcpy(&dfd[8], &versionAndSize, 4);
+        dfd[12] = colorModel;
+        dfd[13] = 1;    // BT709 primaries
+        dfd[14] = 1;    // linear transfer, the runtime samples these as UNORM like the source images
+        dfd[15] = 0;
+        dfd[16] = 3;    // 4x4 texel blocks
+        dfd[17] = 3;
+        dfd[20] = (unsigned char)blockBytes(vkFormat);
+        for (size_t s = 0; s < channels.size(); s++) {
+            unsigned char *sample = &dfd[28 + 16 * s];
+            uint16_t bitOffset = (uint16_t)(64 * s);
+            memcpy(sample, &bitOffset, 2);
+            sample[2] = 63;
+            sample[3] = channels[s];
+            uint32_t upper = 0xFFFFFFFF;
+            memcpy(sample + 12, &upper, 4);
+        }
+        return dfd;
+    }
+
+    // writes levels (level 0 first, each levelSize() bytes) as a KTX2 file
+    inline bool write(std::string const &path, uint32_t vkFormat, uint32_t width, uint32_t height,
+                      const std::vector<std::vector<unsigned char>> &levels) {
+        Header header;
+        memset(&header, 0, sizeof(Header));
+        memcpy(header.identifier, IDENTIFIER, sizeof(IDENTIFIER));
+        header.vkFormat = vkFormat;
+        header.typeSize = 1;
+        header.pixelWidth = width;
+        header.pixelHeight = height;
+        header.faceCount = 1;
+        header.levelCount = (uint32_t)levels.size();
+
+        std::vector<unsigned char> dfd = dataFormatDescriptor(vkFormat);
+        uint64_t offset = sizeof(Header) + levels.size() * sizeof(LevelIndex);
+        header.dfdByteOffset = (uint32_t)offset;
+        header.dfdByteLength = (uint32_t)dfd.size();
+        offset += dfd.size();
+
+        // mip data goes smallest level first, each level aligned to the block size
+        std::vector<LevelIndex> index(levels.size());
+        for (size_t i = levels.size(); i-- > 0;) {
+            uint64_t align = blockBytes(vkFormat);
+            offset = (offset + align - 1) / align * align;
+            index[i].byteOffset = offset;
+            index[i].byteLength = levels[i].size();
+            index[i].uncompressedByteLength = levels[i].size();
+            offset += levels[i].size();
+        }
+
+        std::ofstream out(path, std::ios::binary);
+        if (!out) {
+            std::cout << "ERROR::KTX2:: could not open " << path << " for writing" << std::endl;
+            return false;
+        }
+        std::vector<unsigned char> file(offset, 0);
+        memcpy(&file[0], &header, sizeof(Header));
+        memcpy(&file[sizeof(Header)], index.data(), index.size() * sizeof(LevelIndex));
+        memcpy(&file[header.dfdByteOffset], dfd.data(), dfd.size());
+        for (size_t i = 0; i < levels.size(); i++) {
+            memcpy(&file[index[i].byteOffset], levels[i].data(), levels[i].size());
+        }
+        out.write((const char *)file.data(), file.size());
+        return out.good();
+    }
+}
+#endif
@@ -0,0 +1,101 @@
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <sys/resource.h>
+#else
+#include <sys/resource.h>
+#endif
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+// Resident set size of the process, for reporting what loading costs in memory.
+namespace memory_stats {
+
+#if defined(__linux__)
+    // reads a "Field:   1234 kB" line of /proc/self/status
+    inline size_t statusField(const char *field) {
+        FILE *status = fopen("/proc/self/status", "r");
+        if (!status) {
+            return 0;
+        }
+        char line[256];
+        size_t kb = 0;
+        size_t length = strlen(field);
+        while (fgets(line, sizeof(line), status)) {
+            if (strncmp(line, field, length) == 0 && line[length] == ':') {
+                sscanf(line + length + 1, "%zu", &kb);
+                break;
+            }
+        }
+        fclose(status);
+        return kb * 1024;
+    }
+#endif
+
+    // bytes currently resident
+    inline size_t currentRss() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#elif defined(__APPLE__)
+        mach_task_basic_info_data_t info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+            return 0;
+        }
+        return info.resident_size;
+#elif defined(__linux__)
+        return statusField("VmRSS");
+#else
+        return 0;
+#endif
+    }
+
+    // highest resident size since the process started
+    inline size_t peakRss() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#elif defined(__APPLE__)
+        struct rusage usage;
+        // bytes on macOS
+        return getrusage(RUSAGE_SELF, &usage) == 0 ? (size_t)usage.ru_maxrss : 0;
+#elif defined(__linux__)
+        return statusField("VmHWM");
+#else
+        struct rusage usage;
+        // kilobytes elsewhere
+        return getrusage(RUSAGE_SELF, &usage) == 0 ? (size_t)usage.ru_maxrss * 1024 : 0;
+#endif
+    }
+
+    // hands freed heap memory back to the system where the allocator holds on to it (glibc),
+    // so a large free shows up in the resident size
+    inline void trimHeap() {
+#if defined(__GLIBC__)
+        malloc_trim(0);
+#endif
+    }
+
+    inline double megabytes(size_t bytes) {
+        return bytes / (1024.0 * 1024.0);
+    }
+}
+#endif
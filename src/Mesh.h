@@ -9,7 +9,11 @@
 #include <glm/gtc/quaternion.hpp>
 
 #include "Shader.h"
+#include "Vertex.h"
+#include "GeometryArena.h"
+#include "Meshlets.h"
 
+#include <algorithm>
 #include <string>
 #include <array>
 #include <map>
@@ -19,28 +23,16 @@
 #include <vector>
 using namespace std;
 
-const int MAX_BONES_VERTEX = 4;
-// max bones that can be read - must match vertex shader
-const int MAX_BONES = 110;
-
-//TODO add skinned mesh data to vertices (bone weights)
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-    // weights of bones affecting this vertex
-    float boneWeights[MAX_BONES_VERTEX] = {0};
-    // id's of said bones, needed to index into the transformations array in vert shader
-    int boneIds[MAX_BONES_VERTEX] = {0};
-    //num bones affecting this vertex
-    unsigned int numBones = 0;
+// how the bone transforms of a model are blended in the vertex shader
+enum Skinning_Mode {
+    SKINNING_LINEAR_BLEND,  // blend 4 full bone matrices, 4 vec4 per bone
+    SKINNING_DUAL_QUAT      // blend dual quaternions, 2 vec4 per bone
+};
+
+// what happens to a mesh's CPU copy of its geometry once it is in the arena
+enum Geometry_Retention {
+    GEOMETRY_RELEASE,   // free it, the mesh only lives on the GPU
+    GEOMETRY_KEEP       // keep it for CPU work like collision, picking (see CpuSkinning.h) or baking
 };
 
 struct Texture {
@@ -50,6 +42,8 @@ struct Texture {
 };
 
 struct Bone {
+    // name of the node this bone was made from
+    std::string name;
     // location in final array
     int loc;
     // position transformations keyframes
@@ -120,37 +114,250 @@ struct Bone {
     }
 };
 
+// bone transforms laid out the way the std140 AnimationBlock (vec4 bonePalette[4 * MAX_BONES]) reads them
+struct BonePalette {
+    Skinning_Mode mode = SKINNING_LINEAR_BLEND;
+    std::array<glm::vec4, 4 * MAX_BONES> data = {};
+
+    int vec4PerBone() const {
+        return mode == SKINNING_DUAL_QUAT ? 2 : 4;
+    }
+
+    // only the part of the palette the current mode uses gets uploaded
+    size_t byteSize() const {
+        return vec4PerBone() * MAX_BONES * sizeof(glm::vec4);
+    }
+
+    void set(int loc, const glm::mat4 &transform) {
+        if (mode == SKINNING_DUAL_QUAT) {
+            // dual quaternions are rigid, so bone scale is dropped and the rotation taken from the normalized basis
+            glm::mat3 basis(glm::normalize(glm::vec3(transform[0])),
+                            glm::normalize(glm::vec3(transform[1])),
+                            glm::normalize(glm::vec3(transform[2])));
+            glm::quat real = glm::normalize(glm::quat_cast(basis));
+            glm::vec3 t = glm::vec3(transform[3]);
+            glm::quat dual = glm::quat(0.0f, t.x, t.y, t.z) * real * 0.5f;
+            data[2*loc] = glm::vec4(real.x, real.y, real.z, real.w);
+            data[2*loc + 1] = glm::vec4(dual.x, dual.y, dual.z, dual.w);
+        }
+        else {
+            for (int c = 0; c < 4; c++) {
+                data[4*loc + c] = transform[c];
+            }
+        }
+    }
+};
+
 class Mesh {
 public:
     /*  Mesh Data  */
     vector<Vertex> vertices;
     vector<unsigned int> indices;
     vector<Texture> textures;
-    unsigned int VAO;
+    Vertex_Format format = VERTEX_FULL;
+    // where the geometry lives in the arena of its format. the CPU arrays above are empty
+    // for meshes uploaded straight from a baked file
+    GeometryArena::Range range;
+    // index lists of decreasing detail over the same vertices, lods[0] is the full mesh (see MeshSimplifier.h)
+    struct Lod {
+        GLuint firstIndex;
+        GLuint indexCount;
+        float error;    // how far the surface moved, in model units
+    };
+    vector<Lod> lods;
+    // CPU copy of the index lists of lods[1...], kept and freed along with vertices and indices
+    vector<vector<unsigned int>> lodIndices;
+    // lods[0] cut into clusters that can be culled on their own, firstIndex relative to lods[0].firstIndex
+    vector<meshlets::Meshlet> clusters;
 
     /*  Functions  */
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor, takes over the arrays and copies the geometry into the shared buffers
+    Mesh(vector<Vertex> &&vertices, vector<unsigned int> &&indices, vector<Texture> &&textures, Vertex_Format format = VERTEX_FULL,
+         Geometry_Retention retention = GEOMETRY_KEEP) :
+        vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), format(format)
+    {
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+        if (retention == GEOMETRY_RELEASE) {
+            releaseGeometry();
+        }
+    }
+    
+    // constructor uploading geometry that lives elsewhere (a mapped baked model file), no CPU copy is kept
+    Mesh(const Vertex *vertexData, size_t numVertices, const unsigned int *indexData, size_t numIndices, vector<Texture> &&textures,
+         Vertex_Format format = VERTEX_FULL) : textures(std::move(textures)), format(format)
+    {
+        setupMesh(vertexData, numVertices, indexData, numIndices);
+    }
+
+    // constructor only reserving room in the arena, the geometry is written afterwards with writeVertices
+    // and writeIndices, in as many pieces as the caller likes. no CPU copy is kept
+    Mesh(size_t numVertices, size_t numIndices, vector<Texture> &&textures, Vertex_Format format = VERTEX_FULL) :
+        textures(std::move(textures)), format(format)
+    {
+        range = arena().reserve(numVertices, numIndices);
+        Lod full = {range.firstIndex, range.indexCount, 0.0f};
+        lods.assign(1, full);
+    }
+
+    // meshes are only ever moved, the GPU side lives in the arena and the CPU arrays can be large.
+    // a moved from mesh owns no arena range anymore
+    Mesh(Mesh &&other) noexcept :
+        vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)),
+        format(other.format), range(other.range), lods(std::move(other.lods)), lodIndices(std::move(other.lodIndices)),
+        clusters(std::move(other.clusters)),
+        samplerLocations(std::move(other.samplerLocations))
+    {
+        other.range = GeometryArena::Range();
+        other.lods.clear();
+    }
+
+    Mesh &operator=(Mesh &&other) noexcept
+    {
+        if (this != &other) {
+            releaseArena();
+            vertices = std::move(other.vertices);
+            indices = std::move(other.indices);
+            textures = std::move(other.textures);
+            format = other.format;
+            range = other.range;
+            lods = std::move(other.lods);
+            lodIndices = std::move(other.lodIndices);
+            clusters = std::move(other.clusters);
+            samplerLocations = std::move(other.samplerLocations);
+            other.range = GeometryArena::Range();
+            other.lods.clear();
+        }
+        return *this;
+    }
+
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+
+    // gives the geometry back to the arena, the textures belong to the model
+    ~Mesh()
+    {
+        releaseArena();
+    }
+
+    // frees the CPU copy of the geometry, the mesh still draws from the arena
+    void releaseGeometry()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+        vector<vector<unsigned int>>().swap(lodIndices);
+    }
+
+    GeometryArena &arena() const
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        return GeometryArena::forFormat(format);
+    }
 
-        // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+    // reserves the next level of detail, its indices are written with writeIndices
+    void reserveLod(size_t numIndices, float error)
+    {
+        Lod lod = {arena().reserveIndices(numIndices), (GLuint)numIndices, error};
+        lods.push_back(lod);
     }
 
-    // render the mesh
-    void Draw(Shader *shader, std::array<glm::mat4, 110> *animationTransforms)
+    // fills count of the mesh's vertices starting at first
+    void writeVertices(size_t first, const Vertex *vertexData, size_t count)
     {
-        // bind appropriate textures
+        arena().writeVertices(range.baseVertex + first, vertexData, count);
+    }
+
+    // fills count indices of a level of detail starting at first, lod 0 is the full mesh
+    void writeIndices(unsigned int lod, size_t first, const unsigned int *indexData, size_t count)
+    {
+        arena().writeIndices(lods[lod].firstIndex + first, indexData, count);
+    }
+
+    // the indirect draw command for this mesh at a level of detail, the coarsest it has if lod is past it
+    DrawElementsIndirectCommand drawCommand(unsigned int lod = 0) const
+    {
+        const Lod &level = lods[std::min<size_t>(lod, lods.size() - 1)];
+        DrawElementsIndirectCommand command = {level.indexCount, 1, level.firstIndex, range.baseVertex, 0};
+        return command;
+    }
+
+    // render the mesh on its own, models submit all their meshes at once instead
+    void Draw(Shader *shader)
+    {
+        bindTextures(shader);
+        
+        // draw mesh. the VAO stays bound, GLState skips binding it again for the next draw
+        GLState::instance().bindVertexArray(arena().vao());
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (void*)(range.firstIndex * sizeof(unsigned int)), range.baseVertex);
+    }
+    
+    // skin the mesh into its part of the arena's skin cache, expects the skinning program bound and rasterization discarded
+    void Skin()
+    {
+        GLState::instance().bindVertexArray(arena().vao());
+        glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, arena().skinnedBuffer(),
+                          range.baseVertex * sizeof(SkinnedVertex), range.vertexCount * sizeof(SkinnedVertex));
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, range.baseVertex, range.vertexCount);
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    }
+    
+    // render the mesh from the vertices written by the last Skin()
+    void DrawSkinned(Shader *shader)
+    {
+        bindTextures(shader);
+        
+        GLState::instance().bindVertexArray(arena().skinnedVao());
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (void*)(range.firstIndex * sizeof(unsigned int)), range.baseVertex);
+    }
+    
+    // makes sure the arena has a skin cache this mesh can be skinned into
+    void setupSkinCache()
+    {
+        arena().enableSkinCache();
+    }
+
+    // bind appropriate textures and point the samplers at them
+    void bindTextures(Shader *shader)
+    {
+        const vector<GLint> &locations = samplerLocationsFor(shader);
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            // set the sampler to the correct texture unit
+            glUniform1i(locations[i], i);
+            // and bind the texture there, unless it already is
+            GLState::instance().bindTexture(i, textures[i].id);
+        }
+    }
+
+private:
+    // sampler location of each texture in a program the mesh was drawn with
+    struct SamplerLocations {
+        unsigned int program;
+        vector<GLint> locations;
+    };
+    vector<SamplerLocations> samplerLocations;
+
+    /*  Functions    */
+    // the sampler locations of the textures in shader, named after their type and number (texture_diffuse1, texture_normal1...).
+    // the names are only built the first time a program draws the mesh
+    const vector<GLint> &samplerLocationsFor(Shader *shader)
+    {
+        for (SamplerLocations &entry : samplerLocations)
+        {
+            if (entry.program == shader->ID && entry.locations.size() == textures.size())
+                return entry.locations;
+        }
+        samplerLocations.erase(std::remove_if(samplerLocations.begin(), samplerLocations.end(),
+                                              [shader](const SamplerLocations &entry) { return entry.program == shader->ID; }),
+                               samplerLocations.end());
+        SamplerLocations entry;
+        entry.program = shader->ID;
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -162,89 +369,33 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
              else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader->ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-            
-        }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-        
-        if (animationTransforms) {
-            // bind animation buffer
-            glUniformBlockBinding(shader->ID, glGetUniformBlockIndex(shader->ID, "AnimationBlock"), 0);
-            glBindBuffer(GL_UNIFORM_BUFFER, ABO);
-            glBufferSubData(GL_UNIFORM_BUFFER, 0, MAX_BONES * sizeof(glm::mat4), animationTransforms);
-            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            entry.locations.push_back(shader->uniform(name + number).location);
         }
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        samplerLocations.push_back(std::move(entry));
+        return samplerLocations.back().locations;
     }
 
-private:
-    /*  Render data  */
-    unsigned int VBO, EBO, ABO;
 
-    /*  Functions    */
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    // frees the range and the index lists of the coarser levels, lods[0] is part of the range
+    void releaseArena()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-        
-        // set up UBO for animation buffer object
-        glGenBuffers(1, &ABO);
-        glBindBuffer(GL_UNIFORM_BUFFER, ABO);
-        glBufferData(GL_UNIFORM_BUFFER, MAX_BONES * sizeof(glm::mat4), NULL, GL_STATIC_DRAW);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
-        // define the range of the buffer that links to a uniform binding point
-        glBindBufferRange(GL_UNIFORM_BUFFER, 0, ABO, 0, MAX_BONES * sizeof(glm::mat4));
-        
-        
+        if (lods.empty()) {
+            return;
+        }
+        for (size_t l = 1; l < lods.size(); l++) {
+            arena().releaseIndices(lods[l].firstIndex, lods[l].indexCount);
+        }
+        arena().release(range);
+        range = GeometryArena::Range();
+        lods.clear();
+    }
 
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-        // bone ids
-        glEnableVertexAttribArray(5);
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, boneIds));
-        // bone weights
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, boneWeights));
-
-        glBindVertexArray(0);
+    // copies the geometry into the arena of the mesh's vertex format
+    void setupMesh(const Vertex *vertexData, size_t numVertices, const unsigned int *indexData, size_t numIndices)
+    {
+        range = arena().allocate(vertexData, numVertices, indexData, numIndices);
+        Lod full = {range.firstIndex, range.indexCount, 0.0f};
+        lods.assign(1, full);
     }
 };
 #endif
@@ -0,0 +1,294 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include "Vertex.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+// Level of detail generation by quadric error edge collapse (Garland & Heckbert). Vertices are only
+// ever collapsed into one of their neighbours, so a simplified mesh is a new index list over the
+// original vertex buffer and every vertex left keeps its own position, UVs and skin weights.
+namespace mesh_simplifier {
+
+    // how much a collapse that swaps a vertex's bone influences entirely costs, as a fraction of the mesh size
+    const double SKIN_PENALTY = 0.05;
+    // collapses between vertices whose influences differ more than this are refused outright
+    const float MAX_SKIN_DISTANCE = 0.5f;
+
+    // weighted squared distances to a set of planes, as a symmetric 4x4 matrix and the total weight
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+        double b0 = 0, b1 = 0, b2 = 0;
+        double c = 0;
+        double w = 0;
+
+        // the plane dot(n, p) + d = 0, n of unit length
+        void addPlane(glm::dvec3 n, double d, double weight) {
+            a00 += weight * n.x * n.x; a01 += weight * n.x * n.y; a02 += weight * n.x * n.z;
+            a11 += weight * n.y * n.y; a12 += weight * n.y * n.z; a22 += weight * n.z * n.z;
+            b0 += weight * n.x * d; b1 += weight * n.y * d; b2 += weight * n.z * d;
+            c += weight * d * d;
+            w += weight;
+        }
+
+        void add(const Quadric &q) {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2;
+            c += q.c;
+            w += q.w;
+        }
+
+        // mean squared distance of p to the planes
+        double error(glm::dvec3 p) const {
+            double e = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+                     + 2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z)
+                     + 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+            return e > 0.0 && w > 0.0 ? e / w : 0.0;
+        }
+    };
+
+    inline float boneWeight(const Vertex &v, int bone) {
+        float weight = 0.0f;
+        for (int i = 0; i < MAX_BONES_VERTEX; i++) {
+            if (v.boneWeights[i] > 0.0f && v.boneIds[i] == bone) {
+                weight += v.boneWeights[i];
+            }
+        }
+        return weight;
+    }
+
+    // how different the bone influences of two vertices are, 0 when identical, 1 when disjoint
+    inline float skinDistance(const Vertex &a, const Vertex &b) {
+        float distance = 0.0f;
+        for (int i = 0; i < MAX_BONES_VERTEX; i++) {
+            if (a.boneWeights[i] > 0.0f) {
+                distance += fabsf(a.boneWeights[i] - boneWeight(b, a.boneIds[i]));
+            }
+            if (b.boneWeights[i] > 0.0f && boneWeight(a, b.boneIds[i]) == 0.0f) {
+                distance += b.boneWeights[i];
+            }
+        }
+        return 0.5f * distance;
+    }
+
+    // length of the diagonal of the mesh's bounding box
+    inline float extent(const Vertex *vertices, size_t vertexCount) {
+        if (vertexCount == 0) {
+            return 0.0f;
+        }
+        glm::vec3 lo = vertices[0].Position, hi = lo;
+        for (size_t i = 1; i < vertexCount; i++) {
+            lo = glm::min(lo, vertices[i].Position);
+            hi = glm::max(hi, vertices[i].Position);
+        }
+        return glm::length(hi - lo);
+    }
+
+    // Collapses vertices into neighbours, cheapest first, until the index list is down to targetIndexCount or
+    // the next collapse would move the surface by more than maxError (model units). Vertices on UV or normal
+    // seams (several vertices at one position) and on open borders stay where they are, which keeps texture
+    // charts and silhouette edges intact, and collapses that flip a triangle or mix bone influences are refused.
+    // indices is a triangle list. resultError receives the largest error of the collapses made.
+    inline std::vector<unsigned int> simplify(const Vertex *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount,
+                                             size_t targetIndexCount, float maxError, float *resultError = nullptr)
+    {
+        assert(indexCount % 3 == 0);
+        std::vector<unsigned int> result(indices, indices + indexCount);
+        if (resultError) {
+            *resultError = 0.0f;
+        }
+        if (indexCount < 3 || vertexCount == 0) {
+            return result;
+        }
+        double size = std::max((double)extent(vertices, vertexCount), 1e-12);
+
+        // vertices at the same position are wedges of one corner, welded[] points them all at the first of them
+        std::vector<unsigned int> order(vertexCount);
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(), [vertices](unsigned int a, unsigned int b) {
+            const glm::vec3 &p = vertices[a].Position, &q = vertices[b].Position;
+            return p.x != q.x ? p.x < q.x : (p.y != q.y ? p.y < q.y : p.z < q.z);
+        });
+        std::vector<unsigned int> welded(vertexCount);
+        std::vector<unsigned char> locked(vertexCount, 0);
+        for (size_t i = 0; i < vertexCount;) {
+            size_t j = i + 1;
+            while (j < vertexCount && vertices[order[j]].Position == vertices[order[i]].Position) {
+                j++;
+            }
+            for (size_t k = i; k < j; k++) {
+                welded[order[k]] = order[i];
+            }
+            // a seam, moving it would tear the texture
+            if (j - i > 1) {
+                locked[order[i]] = 1;
+            }
+            i = j;
+        }
+
+        // edges used by a single triangle are on an open border
+        std::unordered_map<uint64_t, unsigned int> edgeUse;
+        edgeUse.reserve(indexCount);
+        for (size_t t = 0; t + 2 < indexCount; t += 3) {
+            for (int e = 0; e < 3; e++) {
+                uint64_t a = welded[result[t + e]], b = welded[result[t + (e + 1) % 3]];
+                edgeUse[a < b ? (a << 32 | b) : (b << 32 | a)]++;
+            }
+        }
+        for (std::unordered_map<uint64_t, unsigned int>::const_iterator it = edgeUse.begin(); it != edgeUse.end(); ++it) {
+            if (it->second == 1) {
+                locked[it->first >> 32] = 1;
+                locked[it->first & 0xFFFFFFFFu] = 1;
+            }
+        }
+
+        // every corner starts with the planes of the triangles around it, weighted by their area
+        std::vector<Quadric> quadrics(vertexCount);
+        for (size_t t = 0; t + 2 < indexCount; t += 3) {
+            glm::dvec3 p0 = glm::dvec3(vertices[result[t]].Position);
+            glm::dvec3 p1 = glm::dvec3(vertices[result[t + 1]].Position);
+            glm::dvec3 p2 = glm::dvec3(vertices[result[t + 2]].Position);
+            glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+            double area = glm::length(n);
+            if (area < 1e-20) {
+                continue;
+            }
+            n /= area;
+            Quadric q;
+            q.addPlane(n, -glm::dot(n, p0), 0.5 * area);
+            for (int c = 0; c < 3; c++) {
+                quadrics[welded[result[t + c]]].add(q);
+            }
+        }
+
+        struct Collapse {
+            unsigned int from, to;
+            double cost;
+        };
+        double errorLimit = (double)maxError * maxError;
+        double skinScale = SKIN_PENALTY * size;
+        double reached = 0.0;
+        std::vector<unsigned int> collapseTo(vertexCount);
+        std::iota(collapseTo.begin(), collapseTo.end(), 0u);
+        std::vector<unsigned char> touched(vertexCount);
+        std::vector<unsigned int> adjacencyStart(vertexCount + 1), adjacency;
+        std::vector<Collapse> candidates;
+
+        while (result.size() > targetIndexCount) {
+            // triangles around each vertex
+            std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0u);
+            for (size_t i = 0; i < result.size(); i++) {
+                adjacencyStart[result[i] + 1]++;
+            }
+            for (size_t v = 0; v < vertexCount; v++) {
+                adjacencyStart[v + 1] += adjacencyStart[v];
+            }
+            adjacency.resize(result.size());
+            std::vector<unsigned int> cursor(adjacencyStart.begin(), adjacencyStart.end() - 1);
+            for (size_t i = 0; i < result.size(); i++) {
+                adjacency[cursor[result[i]]++] = (unsigned int)(i / 3);
+            }
+
+            // every directed edge whose first vertex may move is a candidate
+            candidates.clear();
+            for (size_t t = 0; t < result.size(); t += 3) {
+                for (int e = 0; e < 6; e++) {
+                    unsigned int from = result[t + e % 3];
+                    unsigned int to = result[t + (e / 3 == 0 ? (e + 1) % 3 : (e + 2) % 3)];
+                    if (locked[welded[from]] || welded[from] == welded[to]) {
+                        continue;
+                    }
+                    float skin = skinDistance(vertices[from], vertices[to]);
+                    if (skin > MAX_SKIN_DISTANCE) {
+                        continue;
+                    }
+                    Quadric q = quadrics[welded[from]];
+                    q.add(quadrics[welded[to]]);
+                    double cost = q.error(glm::dvec3(vertices[to].Position)) + (skin * skinScale) * (skin * skinScale);
+                    candidates.push_back({from, to, cost});
+                }
+            }
+            std::sort(candidates.begin(), candidates.end(), [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+            // take the cheapest collapses whose neighbourhoods don't overlap, each removes about two triangles
+            std::fill(touched.begin(), touched.end(), 0);
+            size_t wanted = (result.size() - targetIndexCount + 5) / 6;
+            std::vector<unsigned int> collapsed;
+            for (size_t c = 0; c < candidates.size() && collapsed.size() < wanted; c++) {
+                const Collapse &collapse = candidates[c];
+                if (collapse.cost > errorLimit) {
+                    break;
+                }
+                if (touched[welded[collapse.from]] || touched[welded[collapse.to]]) {
+                    continue;
+                }
+                // refuse if a triangle that stays would turn over
+                bool flips = false;
+                glm::vec3 target = vertices[collapse.to].Position;
+                for (unsigned int a = adjacencyStart[collapse.from]; a < adjacencyStart[collapse.from + 1] && !flips; a++) {
+                    const unsigned int *tri = &result[adjacency[a] * 3];
+                    glm::vec3 p[3], q[3];
+                    bool removed = false;
+                    for (int k = 0; k < 3; k++) {
+                        p[k] = q[k] = vertices[tri[k]].Position;
+                        if (tri[k] == collapse.from) {
+                            q[k] = target;
+                        }
+                        else if (welded[tri[k]] == welded[collapse.to]) {
+                            removed = true;
+                        }
+                    }
+                    if (!removed) {
+                        glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                        glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                        flips = glm::dot(before, after) <= 0.0f;
+                    }
+                }
+                if (flips) {
+                    continue;
+                }
+                for (unsigned int a = adjacencyStart[collapse.from]; a < adjacencyStart[collapse.from + 1]; a++) {
+                    for (int k = 0; k < 3; k++) {
+                        touched[welded[result[adjacency[a] * 3 + k]]] = 1;
+                    }
+                }
+                collapseTo[collapse.from] = collapse.to;
+                quadrics[welded[collapse.to]].add(quadrics[welded[collapse.from]]);
+                reached = std::max(reached, collapse.cost);
+                collapsed.push_back(collapse.from);
+            }
+            if (collapsed.empty()) {
+                break;
+            }
+
+            // rewrite the triangles and drop the ones that became degenerate
+            size_t write = 0;
+            for (size_t t = 0; t < result.size(); t += 3) {
+                unsigned int a = collapseTo[result[t]], b = collapseTo[result[t + 1]], c = collapseTo[result[t + 2]];
+                if (welded[a] != welded[b] && welded[b] != welded[c] && welded[a] != welded[c]) {
+                    result[write++] = a;
+                    result[write++] = b;
+                    result[write++] = c;
+                }
+            }
+            result.resize(write);
+            for (size_t i = 0; i < collapsed.size(); i++) {
+                collapseTo[collapsed[i]] = collapsed[i];
+            }
+        }
+
+        if (resultError) {
+            *resultError = (float)sqrt(reached);
+        }
+        return result;
+    }
+}
+#endif
@@ -0,0 +1,254 @@
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MESHLETS_SSE 1
+#endif
+
+// Splits index lists into clusters of around a hundred triangles that each get a bounding sphere and a
+// normal cone, so whole clusters off screen or facing away from the camera can be skipped before their
+// triangles reach the rasterizer. Clusters are contiguous ranges of the index list they were built from,
+// which keeps its (cache optimized) order and lets draws cover runs of visible clusters with one command.
+namespace meshlets {
+
+    // a cluster closes once it has this many triangles
+    const unsigned int MAX_TRIANGLES = 128;
+    // or once another triangle would bring in more distinct vertices than this
+    const unsigned int MAX_VERTICES = 64;
+    // normal cones wider than this (the cosine between the axis and the furthest normal) can't be culled
+    const float MIN_CONE_SPREAD = 0.1f;
+
+    struct Meshlet {
+        unsigned int firstIndex = 0;
+        unsigned int indexCount = 0;
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+        // unit axis of the normal cone, and the sine of its spread: the cluster faces away from every
+        // camera position where dot(center - camera, axis) >= coneCutoff * length(center - camera) + radius.
+        // 1 disables the test
+        glm::vec3 coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+        float coneCutoff = 1.0f;
+        // the bone that moves the cluster in a skinned mesh, -1 if it doesn't move with one
+        int bone = -1;
+        // true if every vertex follows bone closely enough for the bounds to move with it unchanged
+        bool rigid = true;
+    };
+
+    // bounding sphere and normal cone of the triangles in indices[0, indexCount). positionOf(index) gives a vertex position
+    template<typename PositionOf>
+    Meshlet bounds(const unsigned int *indices, size_t indexCount, PositionOf positionOf)
+    {
+        Meshlet meshlet;
+        meshlet.indexCount = (unsigned int)indexCount;
+        if (indexCount < 3) {
+            return meshlet;
+        }
+
+        glm::vec3 lo = positionOf(indices[0]), hi = lo;
+        for (size_t i = 1; i < indexCount; i++) {
+            glm::vec3 p = positionOf(indices[i]);
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+        meshlet.center = 0.5f * (lo + hi);
+        float radius = 0.0f;
+        for (size_t i = 0; i < indexCount; i++) {
+            radius = std::max(radius, glm::length(positionOf(indices[i]) - meshlet.center));
+        }
+        meshlet.radius = radius;
+
+        // the axis is the average of the unit normals, the spread the furthest any of them is from it
+        std::vector<glm::vec3> normals;
+        normals.reserve(indexCount / 3);
+        glm::vec3 sum(0.0f);
+        for (size_t t = 0; t + 2 < indexCount; t += 3) {
+            glm::vec3 p0 = positionOf(indices[t]);
+            glm::vec3 n = glm::cross(positionOf(indices[t + 1]) - p0, positionOf(indices[t + 2]) - p0);
+            float length = glm::length(n);
+            if (length > 0.0f) {
+                normals.push_back(n / length);
+                sum += normals.back();
+            }
+        }
+        float length = glm::length(sum);
+        if (normals.empty() || length <= 0.0f) {
+            return meshlet;
+        }
+        glm::vec3 axis = sum / length;
+        float minDot = 1.0f;
+        for (size_t i = 0; i < normals.size(); i++) {
+            minDot = std::min(minDot, glm::dot(axis, normals[i]));
+        }
+        meshlet.coneAxis = axis;
+        if (minDot > MIN_CONE_SPREAD) {
+            // the cone of view directions that see no front face is the normal cone widened by 90 degrees
+            // and turned around, cos(spread + 90) = -sin(spread)
+            meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+        }
+        return meshlet;
+    }
+
+    // walks the index list in order and cuts it into clusters of at most maxTriangles triangles and maxVertices vertices
+    template<typename PositionOf>
+    std::vector<Meshlet> build(const unsigned int *indices, size_t indexCount, PositionOf positionOf,
+                               unsigned int maxTriangles = MAX_TRIANGLES, unsigned int maxVertices = MAX_VERTICES)
+    {
+        std::vector<Meshlet> result;
+        std::vector<unsigned int> used;
+        used.reserve(maxVertices + 3);
+        size_t start = 0;
+        for (size_t t = 0; t + 2 < indexCount; t += 3) {
+            size_t added = 0;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[t + k];
+                bool seen = std::find(used.begin(), used.end(), v) != used.end();
+                for (int j = 0; !seen && j < k; j++) {
+                    seen = indices[t + j] == v;
+                }
+                added += seen ? 0 : 1;
+            }
+            if (t > start && ((t - start) / 3 >= maxTriangles || used.size() + added > maxVertices)) {
+                result.push_back(bounds(indices + start, t - start, positionOf));
+                result.back().firstIndex = (unsigned int)start;
+                start = t;
+                used.clear();
+            }
+            for (int k = 0; k < 3; k++) {
+                if (std::find(used.begin(), used.end(), indices[t + k]) == used.end()) {
+                    used.push_back(indices[t + k]);
+                }
+            }
+        }
+        size_t end = indexCount / 3 * 3;
+        if (end > start) {
+            result.push_back(bounds(indices + start, end - start, positionOf));
+            result.back().firstIndex = (unsigned int)start;
+        }
+        return result;
+    }
+
+    // the spheres and cones of a set of clusters laid out for culling four at a time. padded to a multiple of
+    // four with entries that are always culled
+    struct Bounds {
+        std::vector<float> x, y, z, radius;
+        std::vector<float> axisX, axisY, axisZ, cutoff;
+        size_t count = 0;
+
+        void resize(size_t n) {
+            count = n;
+            size_t padded = (n + 3) & ~(size_t)3;
+            x.assign(padded, 0.0f); y.assign(padded, 0.0f); z.assign(padded, 0.0f);
+            radius.assign(padded, -1e30f);
+            axisX.assign(padded, 0.0f); axisY.assign(padded, 0.0f); axisZ.assign(padded, 1.0f);
+            cutoff.assign(padded, 1.0f);
+        }
+
+        size_t padded() const {
+            return x.size();
+        }
+
+        void set(size_t i, glm::vec3 center, float r, glm::vec3 axis, float coneCutoff) {
+            x[i] = center.x; y[i] = center.y; z[i] = center.z;
+            radius[i] = r;
+            axisX[i] = axis.x; axisY[i] = axis.y; axisZ[i] = axis.z;
+            cutoff[i] = coneCutoff;
+        }
+
+        void set(size_t i, const Meshlet &meshlet) {
+            set(i, meshlet.center, meshlet.radius, meshlet.coneAxis, meshlet.coneCutoff);
+        }
+    };
+
+    // the six planes of the frustum of a clip matrix (Gribb and Hartmann), normalized, pointing inwards.
+    // they are in the space the matrix maps from, so projection * view * model gives model space planes
+    inline void frustumPlanes(const glm::mat4 &clip, glm::vec4 planes[6])
+    {
+        glm::vec4 row0(clip[0][0], clip[1][0], clip[2][0], clip[3][0]);
+        glm::vec4 row1(clip[0][1], clip[1][1], clip[2][1], clip[3][1]);
+        glm::vec4 row2(clip[0][2], clip[1][2], clip[2][2], clip[3][2]);
+        glm::vec4 row3(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+        for (int i = 0; i < 6; i++) {
+            float length = glm::length(glm::vec3(planes[i]));
+            if (length > 0.0f) {
+                planes[i] /= length;
+            }
+        }
+    }
+
+    // reference implementation of cull, one cluster at a time
+    inline void cullScalar(const Bounds &bounds, const glm::vec4 planes[6], glm::vec3 camera, unsigned char *visible)
+    {
+        for (size_t i = 0; i < bounds.padded(); i++) {
+            glm::vec3 center(bounds.x[i], bounds.y[i], bounds.z[i]);
+            float r = bounds.radius[i];
+            bool inside = true;
+            for (int p = 0; inside && p < 6; p++) {
+                inside = glm::dot(glm::vec3(planes[p]), center) + planes[p].w >= -r;
+            }
+            glm::vec3 toCenter = center - camera;
+            bool backFacing = glm::dot(toCenter, glm::vec3(bounds.axisX[i], bounds.axisY[i], bounds.axisZ[i]))
+                              >= bounds.cutoff[i] * glm::length(toCenter) + r;
+            visible[i] = inside && !backFacing ? 1 : 0;
+        }
+    }
+
+#ifdef MESHLETS_SSE
+    // the same tests for four clusters per iteration
+    inline void cullSSE(const Bounds &bounds, const glm::vec4 planes[6], glm::vec3 camera, unsigned char *visible)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 cameraX = _mm_set1_ps(camera.x), cameraY = _mm_set1_ps(camera.y), cameraZ = _mm_set1_ps(camera.z);
+        for (size_t i = 0; i < bounds.padded(); i += 4) {
+            __m128 x = _mm_loadu_ps(&bounds.x[i]);
+            __m128 y = _mm_loadu_ps(&bounds.y[i]);
+            __m128 z = _mm_loadu_ps(&bounds.z[i]);
+            __m128 r = _mm_loadu_ps(&bounds.radius[i]);
+
+            // inside unless the sphere is entirely behind one of the planes
+            __m128 inside = _mm_cmpeq_ps(zero, zero);
+            for (int p = 0; p < 6; p++) {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes[p].x)), _mm_mul_ps(y, _mm_set1_ps(planes[p].y))),
+                                             _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(planes[p].z)), _mm_set1_ps(planes[p].w)));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, r), zero));
+            }
+
+            __m128 dx = _mm_sub_ps(x, cameraX), dy = _mm_sub_ps(y, cameraY), dz = _mm_sub_ps(z, cameraZ);
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+            __m128 facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&bounds.axisX[i])), _mm_mul_ps(dy, _mm_loadu_ps(&bounds.axisY[i]))),
+                                       _mm_mul_ps(dz, _mm_loadu_ps(&bounds.axisZ[i])));
+            __m128 backFacing = _mm_cmpge_ps(facing, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&bounds.cutoff[i]), length), r));
+
+            int mask = _mm_movemask_ps(_mm_andnot_ps(backFacing, inside));
+            visible[i] = mask & 1;
+            visible[i + 1] = (mask >> 1) & 1;
+            visible[i + 2] = (mask >> 2) & 1;
+            visible[i + 3] = (mask >> 3) & 1;
+        }
+    }
+#endif
+
+    // sets visible[i] to 1 for the clusters that are at least partly inside the frustum planes and may have triangles
+    // facing camera, 0 for the rest. planes and camera are in the space of the bounds. visible needs bounds.padded() entries
+    inline void cull(const Bounds &bounds, const glm::vec4 planes[6], glm::vec3 camera, unsigned char *visible)
+    {
+#ifdef MESHLETS_SSE
+        cullSSE(bounds, planes, camera, visible);
+#else
+        cullScalar(bounds, planes, camera, visible);
+#endif
+    }
+}
+#endif
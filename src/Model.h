@@ -6,45 +6,91 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
+#include <glm/gtc/type_ptr.hpp>
+// build with TOOTHLESS_NO_ASSIMP to only load baked models (see Model::Bake)
+#ifndef TOOTHLESS_NO_ASSIMP
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <assimp/pbrmaterial.h>
+#endif
 #include <glm/gtx/rotate_vector.hpp>
 
 
 #include <typeinfo>
 
 #include "Mesh.h"
+#include "CpuSkinning.h"
+#include "MeshSimplifier.h"
+#include "IndexOptimizer.h"
 #include "Shader.h"
+#include "BakedModel.h"
+#include "TextureCache.h"
+#include "MemoryStats.h"
+#include "GltfLoader.h"
+#ifndef TOOTHLESS_NO_ASSIMP
 #include "Util.h"
+#endif
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
 #include <vector>
+#include <cstring>
+#include <cfloat>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+// later includes of stb_image.h (TextureBaker.h) only want the declarations
+#undef STB_IMAGE_IMPLEMENTATION
 
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+// returns at once with a placeholder texture, the image streams in later.
+// textures come from the TextureCache, release them there when done
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false, glm::u8vec4 placeholder = glm::u8vec4(255));
+
+// levels of detail generated for every mesh at import, the full mesh included. each keeps about half the triangles of the one before
+const unsigned int LOD_LEVELS = 4;
+// simplification stops at this error, relative to the model's size, even if a level keeps more triangles
+const float LOD_MAX_ERROR = 0.02f;
+// a level is used while its error covers less than this many pixels on screen
+const float LOD_PIXEL_ERROR = 1.0f;
+// how far past the threshold the error has to get before the level changes, so it doesn't flicker at the boundary
+const float LOD_HYSTERESIS = 0.25f;
+// a skinned cluster moves with its main bone unchanged if every vertex has at least this much weight on it
+const float CLUSTER_RIGID_WEIGHT = 0.9f;
+// clusters blended between bones more than that are only frustum culled, with their bounding sphere grown by this factor
+const float CLUSTER_BLEND_SLACK = 1.5f;
+
+// how a model's constructor loads it
+enum Load_Mode {
+    LOAD_BLOCKING,  // import and upload before the constructor returns
+    LOAD_DEFERRED   // the caller runs import() and upload() later, see ModelLoader
+};
 
 class Model
 {
 public:
     /*  Model Data */
-    vector<Texture> textures_loaded;    // stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;    // the distinct textures of this model, each holding a reference in the TextureCache
     vector<Mesh> meshes;
     glm::mat4 inverseBindTransform;
     float debugTime = 0;
     string directory;
     bool gammaCorrection;
     shared_ptr<Bone> boneRoot;
-    std::array<glm::mat4, 110> animationTransforms = {};
+    std::array<glm::mat4, MAX_BONES> animationTransforms = {};
+    // animationTransforms in the format the vertex shader blends, uploaded once per frame
+    BonePalette palette;
     glm::mat4 model = glm::mat4(1.0f);
     glm::vec3 position = glm::vec3(0.0f);
     glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);
@@ -56,17 +102,246 @@ public:
     float yaw = 0.0f;
     float roll = 0.0f;
     bool isAnimated;
-    Assimp::Importer importer;
-    const aiScene* scene;
+    // pins the level of detail when >= 0, see selectLod
+    int lodOverride = -1;
+    // at full detail, skip clusters outside the view frustum, see setCamera
+    bool clusterCulling = true;
+    // read .gltf files with loadGltf, false sends them through assimp like every other format
+    bool nativeGltf = true;
+    // print what import() measured and built, off where only the import itself should be timed
+    bool importReport = true;
+    // also skip clusters facing away from the camera. nothing culls back faces in this renderer, so only
+    // for models without open surfaces that are seen from both sides
+    bool cullBackFacing = false;
 
     /*  Functions   */
-    // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false, bool animated = false) : gammaCorrection(gamma), isAnimated(animated)
+    // constructor, expects a filepath to a 3D model, or to a model baked by Bake() (.tfm).
+    // VERTEX_PACKED uploads 32 byte vertices, only animate.vert knows how to decode them.
+    // GEOMETRY_RELEASE frees the CPU copy of imported meshes once uploaded, SkinOnCpu and Bake need it kept.
+    // LOAD_DEFERRED only sets the model up, path is then loaded with import() and upload()
+    Model(string const &path, bool gamma = false, bool animated = false, Skinning_Mode skinning = SKINNING_LINEAR_BLEND,
+          Vertex_Format vertexFormat = VERTEX_FULL, Geometry_Retention retention = GEOMETRY_RELEASE, Load_Mode mode = LOAD_BLOCKING) :
+        gammaCorrection(gamma), isAnimated(animated), vertexFormat(vertexFormat), geometryRetention(retention)
     {
-        loadModel(path);
+        palette.mode = skinning;
         UpdateVectors();
+        if (mode == LOAD_BLOCKING) {
+            import(path);
+            upload(SIZE_MAX);
+        }
     }
     
+    // reads the file and converts it into staged meshes, the skeleton and the animation clip.
+    // clip names the animation clip to load, the file's last one if none has that name. baked files
+    // bring the clip they were baked with.
+    // makes no GL calls, so it can run on a worker thread. false if the file could not be loaded
+    bool import(string const &path, string const &clip = "flying")
+    {
+        bool loaded = false, baked = false;
+        if (path.size() > 4 && path.compare(path.size() - 4, 4, ".tfm") == 0) {
+            loaded = baked = loadBaked(path);
+            // a stale or damaged bake falls back to the glTF it was baked from, when it sits next to it
+            string source = path.substr(0, path.size() - 4) + ".gltf";
+            if (!loaded && ifstream(source).good()) {
+                cout << "loading " << source << " instead" << endl;
+                return import(source, clip);
+            }
+        }
+        else if (nativeGltf && path.size() > 5 && path.compare(path.size() - 5, 5, ".gltf") == 0) {
+            loaded = loadGltf(path, clip);
+#ifndef TOOTHLESS_NO_ASSIMP
+            if (!loaded && staged.empty() && !boneRoot) {
+                cout << "loading " << path << " through assimp instead" << endl;
+                loaded = loadModel(path, clip);
+            }
+#endif
+        }
+        else {
+#ifndef TOOTHLESS_NO_ASSIMP
+            loaded = loadModel(path, clip);
+#else
+            cout << "ERROR::MODEL:: built without assimp, only baked models can be loaded: " << path << endl;
+#endif
+        }
+        // a baked model brings its levels of detail and clusters along
+        if (loaded && !baked) {
+            buildLods();
+            buildClusters();
+        }
+        importFraction = 1.0f;
+        return loaded;
+    }
+    
+    // creates the GL side of an imported model on the render thread: loads the textures of the staged meshes
+    // and copies them into the arena until about byteBudget bytes of geometry went up. a mesh bigger than
+    // what is left of the budget goes up in pieces over several calls. true once the model is complete and can be drawn
+    bool upload(size_t byteBudget)
+    {
+        if (uploaded) {
+            return true;
+        }
+        if (nextStaged == 0 && stagedPart == 0 && stagedOffset == 0) {
+            meshes.reserve(staged.size());
+        }
+        size_t spent = 0;
+        while (nextStaged < staged.size() && spent < byteBudget) {
+            StagedMesh &mesh = staged[nextStaged];
+            const Vertex *vertexData = mesh.vertexData ? mesh.vertexData : mesh.vertices.data();
+            size_t vertexCount = mesh.vertexData ? mesh.vertexCount : mesh.vertices.size();
+            const unsigned int *indexData = mesh.vertexData ? mesh.indexData : mesh.indices.data();
+            size_t indexCount = mesh.vertexData ? mesh.indexCount : mesh.indices.size();
+            if (stagedPart == 0 && stagedOffset == 0) {
+                // first piece of the mesh, make room for all of it
+                for (unsigned int i = 0; i < mesh.textures.size(); i++) {
+                    mesh.textures[i] = loadTexture(mesh.textures[i].path.c_str(), mesh.textures[i].type);
+                }
+                meshes.emplace_back(vertexCount, indexCount, std::move(mesh.textures), vertexFormat);
+                for (unsigned int l = 0; l < mesh.lodIndices.size(); l++) {
+                    meshes.back().reserveLod(mesh.lodIndices[l].size(), mesh.lodErrors[l]);
+                }
+                meshes.back().clusters = std::move(mesh.clusters);
+            }
+            Mesh &target = meshes.back();
+            // the mesh's arrays in upload order: vertices, indices, then the index list of each coarser level
+            size_t elementSize = stagedPart == 0 ? sizeof(Vertex) : sizeof(unsigned int);
+            size_t total = stagedPart == 0 ? vertexCount : stagedPart == 1 ? indexCount : mesh.lodIndices[stagedPart - 2].size();
+            size_t count = std::min(total - stagedOffset, std::max<size_t>(1, (byteBudget - spent) / elementSize));
+            if (stagedPart == 0) {
+                target.writeVertices(stagedOffset, vertexData + stagedOffset, count);
+            }
+            else {
+                const unsigned int *data = stagedPart == 1 ? indexData : mesh.lodIndices[stagedPart - 2].data();
+                target.writeIndices(stagedPart - 1, stagedOffset, data + stagedOffset, count);
+            }
+            spent += count * elementSize;
+            stagedOffset += count;
+            if (stagedOffset < total) {
+                continue;
+            }
+            stagedOffset = 0;
+            if (++stagedPart < 2 + mesh.lodIndices.size()) {
+                continue;
+            }
+            // the mesh is complete. geometry imported from a model file can stay on the CPU for picking,
+            // CPU skinning and baking, a baked file is unmapped once all meshes are up
+            if (!mesh.vertexData && geometryRetention == GEOMETRY_KEEP) {
+                target.vertices = std::move(mesh.vertices);
+                target.indices = std::move(mesh.indices);
+                target.lodIndices = std::move(mesh.lodIndices);
+            }
+            vector<Vertex>().swap(mesh.vertices);
+            vector<unsigned int>().swap(mesh.indices);
+            vector<vector<unsigned int>>().swap(mesh.lodIndices);
+            stagedPart = 0;
+            nextStaged++;
+        }
+        if (nextStaged < staged.size()) {
+            return false;
+        }
+        vector<StagedMesh>().swap(staged);
+        bakedFile.reset();
+        
+        if (isAnimated) {
+            // set up UBO for the bone palette, sized for the skinning mode's layout (half for dual quaternions),
+            // which is what its AnimationBlock variant declares
+            glGenBuffers(1, &ABO);
+            glBindBuffer(GL_UNIFORM_BUFFER, ABO);
+            glBufferData(GL_UNIFORM_BUFFER, palette.byteSize(), NULL, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            
+            for(unsigned int i = 0; i < meshes.size(); i++){
+                meshes[i].setupSkinCache();
+            }
+        }
+        buildDrawCommands();
+        uploaded = true;
+        return true;
+    }
+    
+    // how much of import() is done, 0 to 1. safe to read from any thread
+    float importProgress() const
+    {
+        return importFraction.load();
+    }
+    
+    // how much of upload() is done, 0 to 1
+    float uploadProgress() const
+    {
+        if (uploaded) {
+            return 1.0f;
+        }
+        return staged.empty() ? 0.0f : (float)nextStaged / staged.size();
+    }
+    
+    // picks the level of detail the next draws use from the model's size on screen: the coarsest level whose
+    // simplification error stays under LOD_PIXEL_ERROR pixels. lodOverride >= 0 pins a level instead
+    void selectLod(const glm::mat4 &projection, const glm::mat4 &view, float viewportHeight)
+    {
+        if (lodErrors.empty()) {
+            return;
+        }
+        if (lodOverride >= 0) {
+            currentLod = std::min<unsigned int>(lodOverride, lodErrors.size() - 1);
+            return;
+        }
+        // bind pose bounds, scaled like the model matrix scales them
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        glm::vec3 center = glm::vec3(view * model * glm::vec4(boundsCenter, 1.0f));
+        float distance = std::max(-center.z, 1e-3f);
+        // pixels per model unit at the model's distance
+        float pixelsPerUnit = scale * projection[1][1] * 0.5f * viewportHeight / distance;
+        
+        // finer while the current level's error shows, coarser while the next level's would not
+        while (currentLod > 0 && lodErrors[currentLod] * pixelsPerUnit > LOD_PIXEL_ERROR * (1.0f + LOD_HYSTERESIS)) {
+            currentLod--;
+        }
+        while (currentLod + 1 < lodErrors.size() && lodErrors[currentLod + 1] * pixelsPerUnit < LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS)) {
+            currentLod++;
+        }
+    }
+    
+    // the level of detail draws use, 0 is full detail
+    unsigned int lod() const
+    {
+        return currentLod;
+    }
+    
+    // the camera of the next draws: picks the level of detail (selectLod) and, at full detail, lets them
+    // cull clusters against the frustum and the camera position
+    void setCamera(const glm::mat4 &projection, const glm::mat4 &view, float viewportHeight)
+    {
+        cameraClip = projection * view;
+        cameraPosition = glm::vec3(glm::inverse(view)[3]);
+        hasCamera = true;
+        selectLod(projection, view, viewportHeight);
+    }
+    
+    // clusters the last draw submitted, and how many the model has
+    size_t clustersDrawn() const
+    {
+        return drawnClusters;
+    }
+    
+    size_t clusterCount() const
+    {
+        return clusterBounds.count;
+    }
+
+    // gives the model's textures back to the cache, which keeps them around for reuse within its budget,
+    // and deletes the model's own buffers. the meshes give their geometry back to the arena themselves
+    ~Model()
+    {
+        for (unsigned int i = 0; i < textures_loaded.size(); i++) {
+            TextureCache::instance().release(textures_loaded[i].id);
+        }
+        if (ABO) glDeleteBuffers(1, &ABO);
+        if (commandBuffer) glDeleteBuffers(1, &commandBuffer);
+        if (visibleCommandBuffer) glDeleteBuffers(1, &visibleCommandBuffer);
+    }
+
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
+    
     void updatePosition(float deltaT) {
         // yaw change needs to accumulate so can fly in circles
         direction = glm::normalize(glm::rotate(direction, glm::radians(-yaw/90.0f), up));
@@ -122,10 +397,72 @@ public:
         up    = glm::normalize(glm::cross(right, direction));
     }
 
-    // draws the (animated) model, and thus all its meshes
+    // the defines of the animate.vert variant that draws (or skins) this model, see ShaderVariants.
+    // they follow from how the model was constructed, so the variant can be built before it has loaded
+    vector<string> shaderDefines() const
+    {
+        vector<string> defines = {"BONE_COUNT " + to_string(MAX_BONES)};
+        if (isAnimated) {
+            defines.push_back("SKINNED");
+        }
+        if (palette.mode == SKINNING_DUAL_QUAT) {
+            defines.push_back("DUAL_QUAT_SKINNING");
+        }
+        if (vertexFormat == VERTEX_PACKED) {
+            defines.push_back("PACKED_VERTICES");
+        }
+        return defines;
+    }
+
+    // draws the (animated) model, and thus all its meshes. shader has to be the variant of shaderDefines()
     void Draw(Shader *shader, double time)
     {
+        updatePose(time);
+        
+        const DrawUniforms &uniforms = drawUniformsFor(shader);
+        shader->setMat4(uniforms.model, model);
+        uploadPalette();
+        
+        submit(shader, GeometryArena::forFormat(vertexFormat).vao());
+    }
+    
+    // runs the skinning shader once for the frame, writing world space vertices into each mesh's skin cache.
+    // skinShader is the shaderDefines() variant of animate.vert linked with transform feedback on WorldPos and TBN
+    void Skin(Shader *skinShader, double time)
+    {
+        updatePose(time);
+        
+        skinShader->use();
+        const DrawUniforms &uniforms = drawUniformsFor(skinShader);
+        skinShader->setMat4(uniforms.model, model);
+        uploadPalette();
         
+        GLState::instance().enable(GL_RASTERIZER_DISCARD);
+        for(unsigned int i = 0; i < meshes.size(); i++){
+            meshes[i].Skin();
+        }
+        GLState::instance().disable(GL_RASTERIZER_DISCARD);
+    }
+    
+    // draws the meshes from the skin cache filled by Skin(), for use with preskinned.vert
+    void DrawSkinned(Shader *shader)
+    {
+        submit(shader, GeometryArena::forFormat(vertexFormat).skinnedVao());
+    }
+    
+    // draw an unanimated model
+    void DrawStill(Shader *shader) {
+        shader->setMat4(drawUniformsFor(shader).model, model);
+        submit(shader, GeometryArena::forFormat(vertexFormat).vao());
+    }
+    
+    void setModel(glm::mat4 m) {
+        model = m;
+    }
+    
+    // builds the model matrix from the flight state and poses the skeleton at the given time
+    void updatePose(double time)
+    {
         // create rotation matrix
         glm::mat4 rotation = glm::mat4(direction.x, direction.y, direction.z, 0,
                                        right.x, right.y, right.z, 0,
@@ -137,113 +474,1126 @@ public:
         model *= rotation;
         
         accumulateTransforms(boneRoot, glm::mat4(1.0f), inverseBindTransform, fmod(time * animTicks*10, animDuration));
+    }
+    
+    // skins the positions of mesh meshIndex on the CPU in world space, with the pose of the last frame.
+    // subset picks the vertices to skin (see cpu_skinning::verticesInfluencedBy), nullptr skins all of them
+    void SkinOnCpu(unsigned int meshIndex, const std::vector<unsigned int> *subset, std::vector<glm::vec3> &out)
+    {
+        cpu_skinning::skinPositions(meshes[meshIndex], animationTransforms.data(), model, subset, out);
+    }
+    
+    // writes the loaded meshes, material textures, skeleton and animation clip to a baked model file (see BakedModel.h)
+    void Bake(string const &path) const
+    {
+        using namespace baked;
+        BakedHeader header = {};
+        memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.vertexStride = sizeof(Vertex);
+        header.meshCount = meshes.size();
+        header.isAnimated = isAnimated;
+        header.animDuration = animDuration;
+        header.animTicks = animTicks;
+        memcpy(header.inverseBindTransform, glm::value_ptr(inverseBindTransform), sizeof(header.inverseBindTransform));
+        memcpy(header.boundsCenter, glm::value_ptr(boundsCenter), sizeof(header.boundsCenter));
+        header.boundsRadius = boundsRadius;
+        
+        vector<BakedMesh> bakedMeshes;
+        vector<BakedTexture> bakedTextures;
+        vector<BakedLod> bakedLods;
+        vector<BakedCluster> bakedClusters;
+        for (const Mesh &mesh : meshes) {
+            BakedMesh bakedMesh = {};
+            bakedMesh.firstVertex = header.vertexCount;
+            bakedMesh.firstIndex = header.indexCount;
+            bakedMesh.vertexCount = mesh.vertices.size();
+            bakedMesh.indexCount = mesh.indices.size();
+            bakedMesh.firstTexture = bakedTextures.size();
+            bakedMesh.textureCount = mesh.textures.size();
+            for (const Texture &texture : mesh.textures) {
+                BakedTexture bakedTexture = {};
+                strncpy(bakedTexture.type, texture.type.c_str(), sizeof(bakedTexture.type) - 1);
+                strncpy(bakedTexture.path, texture.path.c_str(), sizeof(bakedTexture.path) - 1);
+                bakedTextures.push_back(bakedTexture);
+            }
+            bakedMesh.firstLod = bakedLods.size();
+            bakedMesh.lodCount = mesh.lodIndices.size();
+            for (unsigned int l = 0; l < mesh.lodIndices.size(); l++) {
+                BakedLod bakedLod = {header.lodIndexCount, (uint32_t)mesh.lodIndices[l].size(), mesh.lods[l + 1].error};
+                header.lodIndexCount += bakedLod.indexCount;
+                bakedLods.push_back(bakedLod);
+            }
+            bakedMesh.firstCluster = bakedClusters.size();
+            bakedMesh.clusterCount = mesh.clusters.size();
+            for (const meshlets::Meshlet &cluster : mesh.clusters) {
+                BakedCluster bakedCluster = {};
+                bakedCluster.firstIndex = cluster.firstIndex;
+                bakedCluster.indexCount = cluster.indexCount;
+                memcpy(bakedCluster.center, glm::value_ptr(cluster.center), sizeof(bakedCluster.center));
+                bakedCluster.radius = cluster.radius;
+                memcpy(bakedCluster.coneAxis, glm::value_ptr(cluster.coneAxis), sizeof(bakedCluster.coneAxis));
+                bakedCluster.coneCutoff = cluster.coneCutoff;
+                bakedCluster.bone = cluster.bone;
+                bakedCluster.rigid = cluster.rigid;
+                bakedClusters.push_back(bakedCluster);
+            }
+            header.vertexCount += bakedMesh.vertexCount;
+            header.indexCount += bakedMesh.indexCount;
+            bakedMeshes.push_back(bakedMesh);
+        }
         
-        shader->setMat4("model", model);
+        vector<BakedBone> bakedBones;
+        vector<BakedKey> keys;
+        if (boneRoot) {
+            flattenBone(boneRoot, -1, bakedBones, keys);
+        }
+        header.textureCount = bakedTextures.size();
+        header.boneCount = bakedBones.size();
+        header.keyCount = keys.size();
+        header.lodCount = bakedLods.size();
+        header.clusterCount = bakedClusters.size();
         
-        for(unsigned int i = 0; i < meshes.size(); i++){
-            meshes[i].Draw(shader, &animationTransforms);
+        // lay the sections out one after another
+        header.meshesOffset = alignSection(sizeof(BakedHeader));
+        header.texturesOffset = alignSection(header.meshesOffset + bakedMeshes.size() * sizeof(BakedMesh));
+        header.bonesOffset = alignSection(header.texturesOffset + bakedTextures.size() * sizeof(BakedTexture));
+        header.keysOffset = alignSection(header.bonesOffset + bakedBones.size() * sizeof(BakedBone));
+        header.lodsOffset = alignSection(header.keysOffset + keys.size() * sizeof(BakedKey));
+        header.clustersOffset = alignSection(header.lodsOffset + bakedLods.size() * sizeof(BakedLod));
+        header.verticesOffset = alignSection(header.clustersOffset + bakedClusters.size() * sizeof(BakedCluster));
+        header.indicesOffset = alignSection(header.verticesOffset + header.vertexCount * sizeof(Vertex));
+        header.lodIndicesOffset = alignSection(header.indicesOffset + header.indexCount * sizeof(unsigned int));
+        
+        ofstream out(path, ios::binary);
+        if (!out) {
+            cout << "ERROR::BAKED_MODEL:: could not write " << path << endl;
+            return;
         }
-    }
-    
-    // draw an unanimated model
-    void DrawStill(Shader *shader) {
-        shader->setMat4("model", model);
-        for(unsigned int i = 0; i < meshes.size(); i++){
-           meshes[i].Draw(shader, nullptr);
+        // pads up to the section offset before writing it
+        auto writeSection = [&out](uint64_t offset, const void *data, size_t bytes) {
+            while ((uint64_t)out.tellp() < offset) {
+                out.put(0);
+            }
+            out.write((const char *)data, bytes);
+        };
+        writeSection(0, &header, sizeof(header));
+        writeSection(header.meshesOffset, bakedMeshes.data(), bakedMeshes.size() * sizeof(BakedMesh));
+        writeSection(header.texturesOffset, bakedTextures.data(), bakedTextures.size() * sizeof(BakedTexture));
+        writeSection(header.bonesOffset, bakedBones.data(), bakedBones.size() * sizeof(BakedBone));
+        writeSection(header.keysOffset, keys.data(), keys.size() * sizeof(BakedKey));
+        writeSection(header.lodsOffset, bakedLods.data(), bakedLods.size() * sizeof(BakedLod));
+        writeSection(header.clustersOffset, bakedClusters.data(), bakedClusters.size() * sizeof(BakedCluster));
+        writeSection(header.verticesOffset, nullptr, 0);
+        for (const Mesh &mesh : meshes) {
+            out.write((const char *)mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+        }
+        writeSection(header.indicesOffset, nullptr, 0);
+        for (const Mesh &mesh : meshes) {
+            out.write((const char *)mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+        }
+        writeSection(header.lodIndicesOffset, nullptr, 0);
+        for (const Mesh &mesh : meshes) {
+            for (const vector<unsigned int> &lod : mesh.lodIndices) {
+                out.write((const char *)lod.data(), lod.size() * sizeof(unsigned int));
+            }
         }
+        cout << "baked " << header.meshCount << " meshes, " << header.vertexCount << " vertices, " << header.lodCount << " levels of detail, "
+             << header.clusterCount << " clusters, " << header.boneCount << " bones to " << path << endl;
     }
     
-    void setModel(glm::mat4 m) {
-        model = m;
+    // palette slot of the named bone, -1 if the model has no such bone
+    int boneId(string const &name) const
+    {
+        auto it = boneIdMap.find(name);
+        return it == boneIdMap.end() ? -1 : it->second;
     }
     
 private:
     int numBones = 0;
+    Vertex_Format vertexFormat;
+    Geometry_Retention geometryRetention;
     float animDuration = 0;
     float animTicks = 25;
-    std::map<std::string, int> boneIdMap;
+    // bone name -> bone ID (Bone::loc), and bone ID -> the bone in the tree
+    std::unordered_map<std::string, int> boneIdMap;
+    vector<shared_ptr<Bone>> bonesByLoc;
+    // load statistics of the skeleton import
+    double skeletonMs = 0.0;
+    size_t skinWeightCount = 0;
+    // vertex cache misses of the imported meshes before and after reordering them
+    size_t cacheMissesBefore = 0, cacheMissesAfter = 0, cacheTriangles = 0;
+    // texture id -> position in textures_loaded
+    std::unordered_map<unsigned int, size_t> textureIndex;
+    // one indirect command per mesh, grouped into batches of meshes that share their textures
+    struct DrawBatch {
+        unsigned int mesh;      // any mesh of the batch, to bind the textures from
+        size_t firstCommand;
+        size_t commandCount;
+    };
+    // a converted mesh waiting for upload(). its geometry is either owned or points into the mapped baked file,
+    // its textures only have their path and type until upload() loads them
+    struct StagedMesh {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        const Vertex *vertexData = nullptr;
+        size_t vertexCount = 0;
+        const unsigned int *indexData = nullptr;
+        size_t indexCount = 0;
+        vector<Texture> textures;
+        // levels of detail past the full mesh, see buildLods
+        vector<vector<unsigned int>> lodIndices;
+        vector<float> lodErrors;
+        // the full detail index list in clusters, see buildClusters
+        vector<meshlets::Meshlet> clusters;
+    };
+    vector<StagedMesh> staged;
+    size_t nextStaged = 0;
+    // how far upload() got into staged[nextStaged]: which of its arrays (vertices, indices, then the
+    // coarser levels) and how many elements of it
+    size_t stagedPart = 0, stagedOffset = 0;
+    bool uploaded = false;
+    std::atomic<float> importFraction{0.0f};
+    // a baked model stays mapped until its meshes are uploaded
+    std::unique_ptr<baked::MappedFile> bakedFile;
+    // bind pose bounding sphere, for picking the level of detail
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+    // error of each level of detail over all meshes, in model units
+    vector<float> lodErrors;
+    unsigned int currentLod = 0;
+    // LOD_LEVELS blocks of one command per mesh, the batches index into each block the same way
+    vector<DrawElementsIndirectCommand> drawCommands;
+    vector<DrawBatch> drawBatches;
+    // the mesh of each command in a block
+    vector<unsigned int> commandMeshes;
+    unsigned int commandBuffer = 0;
+    // camera given to setCamera, world space
+    glm::mat4 cameraClip = glm::mat4(1.0f);
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    bool hasCamera = false;
+    // world space bounds of every cluster in the current pose, meshes in order, clusterStart[i] is mesh i's first
+    meshlets::Bounds clusterBounds;
+    vector<size_t> clusterStart;
+    vector<unsigned char> clusterVisible;
+    // draw commands and batches for the visible clusters, rebuilt by every culled draw
+    vector<DrawElementsIndirectCommand> visibleCommands;
+    vector<DrawBatch> visibleBatches;
+    unsigned int visibleCommandBuffer = 0;
+    size_t drawnClusters = 0;
+    unsigned int ABO = 0;
+    // handles of the uniforms the draw calls set, for each program the model was drawn with
+    struct DrawUniforms {
+        unsigned int program;
+        UniformHandle model;
+    };
+    vector<DrawUniforms> drawUniforms;
     
     /*  Functions   */
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+    // maps a model written by Bake(), its vertex and index blobs are uploaded straight from the mapping.
+    // the whole file is validated before anything is read from it, false leaves the model untouched
+    bool loadBaked(string const &path)
     {
-        // read file via ASSIMP
-        scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
-        {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+        using namespace baked;
+        bakedFile.reset(new MappedFile(path));
+        const MappedFile &file = *bakedFile;
+        const BakedHeader *header = file.at<BakedHeader>(0);
+        if (file.length() < sizeof(BakedHeader) || memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0) {
+            cout << "ERROR::BAKED_MODEL:: could not read " << path << endl;
+            bakedFile.reset();
+            return false;
+        }
+        if (header->version != VERSION || header->vertexStride != sizeof(Vertex)) {
+            cout << "ERROR::BAKED_MODEL:: " << path << " was baked by an incompatible build, bake it again" << endl;
+            bakedFile.reset();
+            return false;
+        }
+        if (const char *problem = validate(file, MAX_BONES, LOD_LEVELS - 1)) {
+            cout << "ERROR::BAKED_MODEL:: " << path << " is corrupt (" << problem << "), bake it again" << endl;
+            bakedFile.reset();
+            return false;
         }
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
+        
+        const BakedMesh *bakedMeshes = file.at<BakedMesh>(header->meshesOffset);
+        const BakedTexture *bakedTextures = file.at<BakedTexture>(header->texturesOffset);
+        const Vertex *vertices = file.at<Vertex>(header->verticesOffset);
+        const unsigned int *indices = file.at<unsigned int>(header->indicesOffset);
+        const BakedLod *bakedLods = file.at<BakedLod>(header->lodsOffset);
+        const unsigned int *lodIndices = file.at<unsigned int>(header->lodIndicesOffset);
+        const BakedCluster *bakedClusters = file.at<BakedCluster>(header->clustersOffset);
+        boundsCenter = glm::make_vec3(header->boundsCenter);
+        boundsRadius = header->boundsRadius;
+        if (header->lodCount > 0) {
+            lodErrors.assign(LOD_LEVELS, 0.0f);
+        }
+        staged.resize(header->meshCount);
+        for (unsigned int i = 0; i < header->meshCount; i++) {
+            const BakedMesh &bakedMesh = bakedMeshes[i];
+            StagedMesh &mesh = staged[i];
+            for (unsigned int t = 0; t < bakedMesh.textureCount; t++) {
+                const BakedTexture &bakedTexture = bakedTextures[bakedMesh.firstTexture + t];
+                mesh.textures.push_back({0, bakedTexture.type, bakedTexture.path});
+            }
+            mesh.vertexData = vertices + bakedMesh.firstVertex;
+            mesh.vertexCount = bakedMesh.vertexCount;
+            mesh.indexData = indices + bakedMesh.firstIndex;
+            mesh.indexCount = bakedMesh.indexCount;
+            for (unsigned int l = 0; l < bakedMesh.lodCount; l++) {
+                const BakedLod &bakedLod = bakedLods[bakedMesh.firstLod + l];
+                const unsigned int *first = lodIndices + bakedLod.firstIndex;
+                mesh.lodIndices.emplace_back(first, first + bakedLod.indexCount);
+                mesh.lodErrors.push_back(bakedLod.error);
+                lodErrors[l + 1] = std::max(lodErrors[l + 1], bakedLod.error);
+            }
+            for (unsigned int c = 0; c < bakedMesh.clusterCount; c++) {
+                const BakedCluster &bakedCluster = bakedClusters[bakedMesh.firstCluster + c];
+                meshlets::Meshlet cluster;
+                cluster.firstIndex = bakedCluster.firstIndex;
+                cluster.indexCount = bakedCluster.indexCount;
+                cluster.center = glm::make_vec3(bakedCluster.center);
+                cluster.radius = bakedCluster.radius;
+                cluster.coneAxis = glm::make_vec3(bakedCluster.coneAxis);
+                cluster.coneCutoff = bakedCluster.coneCutoff;
+                cluster.bone = bakedCluster.bone;
+                cluster.rigid = bakedCluster.rigid != 0;
+                mesh.clusters.push_back(cluster);
+            }
+        }
+        
+        // rebuild the bone tree, parents always come before their children
+        const BakedBone *bakedBones = file.at<BakedBone>(header->bonesOffset);
+        const BakedKey *keys = file.at<BakedKey>(header->keysOffset);
+        vector<shared_ptr<Bone>> bones(header->boneCount);
+        for (unsigned int i = 0; i < header->boneCount; i++) {
+            const BakedBone &bakedBone = bakedBones[i];
+            shared_ptr<Bone> bone = make_shared<Bone>();
+            bone->name = bakedBone.name;
+            bone->loc = bakedBone.loc;
+            bone->isBone = bakedBone.isBone != 0;
+            bone->boneOffset = glm::make_mat4(bakedBone.boneOffset);
+            const BakedKey *key = keys + bakedBone.firstKey;
+            for (unsigned int k = 0; k < bakedBone.positionKeyCount; k++, key++) {
+                bone->positionKeys.insert(std::make_pair(key->time, glm::vec3(key->value[0], key->value[1], key->value[2])));
+            }
+            for (unsigned int k = 0; k < bakedBone.scaleKeyCount; k++, key++) {
+                bone->scaleKeys.insert(std::make_pair(key->time, glm::vec3(key->value[0], key->value[1], key->value[2])));
+            }
+            for (unsigned int k = 0; k < bakedBone.rotationKeyCount; k++, key++) {
+                bone->rotationKeys.insert(std::make_pair(key->time, glm::quat(key->value[3], key->value[0], key->value[1], key->value[2])));
+            }
+            if (bone->isBone) {
+                boneIdMap.insert(make_pair(bone->name, bone->loc));
+                if (bone->loc >= (int)bonesByLoc.size()) {
+                    bonesByLoc.resize(bone->loc + 1);
+                }
+                bonesByLoc[bone->loc] = bone;
+            }
+            if (bakedBone.parent >= 0) {
+                bones[bakedBone.parent]->children.push_back(bone);
+            }
+            bones[i] = bone;
+        }
+        boneRoot = bones.empty() ? nullptr : bones[0];
+        numBones = boneIdMap.size();
+        
+        isAnimated = header->isAnimated != 0;
+        animDuration = header->animDuration;
+        animTicks = header->animTicks;
+        inverseBindTransform = glm::make_mat4(header->inverseBindTransform);
+        return true;
+    }
+    
+    // appends bone and its subtree to the baked skeleton in pre-order
+    void flattenBone(const shared_ptr<Bone> &bone, int parent, vector<baked::BakedBone> &bones, vector<baked::BakedKey> &keys) const
+    {
+        baked::BakedBone bakedBone = {};
+        strncpy(bakedBone.name, bone->name.c_str(), sizeof(bakedBone.name) - 1);
+        bakedBone.loc = bone->loc;
+        bakedBone.parent = parent;
+        bakedBone.isBone = bone->isBone;
+        bakedBone.positionKeyCount = bone->positionKeys.size();
+        bakedBone.scaleKeyCount = bone->scaleKeys.size();
+        bakedBone.rotationKeyCount = bone->rotationKeys.size();
+        bakedBone.firstKey = keys.size();
+        memcpy(bakedBone.boneOffset, glm::value_ptr(bone->boneOffset), sizeof(bakedBone.boneOffset));
+        for (auto it = bone->positionKeys.begin(); it != bone->positionKeys.end(); it++) {
+            keys.push_back({it->first, {it->second.x, it->second.y, it->second.z, 0.0f}});
+        }
+        for (auto it = bone->scaleKeys.begin(); it != bone->scaleKeys.end(); it++) {
+            keys.push_back({it->first, {it->second.x, it->second.y, it->second.z, 0.0f}});
+        }
+        for (auto it = bone->rotationKeys.begin(); it != bone->rotationKeys.end(); it++) {
+            keys.push_back({it->first, {it->second.x, it->second.y, it->second.z, it->second.w}});
+        }
+        
+        int index = bones.size();
+        bones.push_back(bakedBone);
+        for (int i=0; i < bone->children.size(); i++) {
+            flattenBone(bone->children[i], index, bones, keys);
+        }
+    }
+    
+    // loads the texture at path (relative to the model directory) through the process wide texture cache.
+    // the model keeps one reference per distinct texture, released when it is destroyed
+    Texture loadTexture(const char *path, string const &typeName)
+    {
+        Texture texture;
+        // flat normal while a normal map streams in, white for everything else
+        glm::u8vec4 placeholder = typeName == "texture_normal" ? glm::u8vec4(128, 128, 255, 255) : glm::u8vec4(255);
+        texture.id = TextureFromFile(path, this->directory, false, placeholder);
+        texture.type = typeName;
+        texture.path = path;
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // another mesh of this model already uses it, don't hold two references
+        std::unordered_map<unsigned int, size_t>::iterator loaded = textureIndex.find(texture.id);
+        if (loaded != textureIndex.end()) {
+            TextureCache::instance().release(texture.id);
+            return textures_loaded[loaded->second];
+        }
+        textureIndex[texture.id] = textures_loaded.size();
+        textures_loaded.push_back(texture);
+        return texture;
+    }
+    
+    // simplifies every staged mesh into LOD_LEVELS - 1 coarser index lists, each from the one before, and
+    // measures the bind pose bounds. runs at the end of import()
+    void buildLods()
+    {
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for (unsigned int i = 0; i < staged.size(); i++) {
+            const StagedMesh &mesh = staged[i];
+            const Vertex *vertices = mesh.vertexData ? mesh.vertexData : mesh.vertices.data();
+            size_t vertexCount = mesh.vertexData ? mesh.vertexCount : mesh.vertices.size();
+            for (size_t v = 0; v < vertexCount; v++) {
+                lo = glm::min(lo, vertices[v].Position);
+                hi = glm::max(hi, vertices[v].Position);
+            }
+        }
+        if (lo.x > hi.x) {
+            return;
+        }
+        boundsCenter = 0.5f * (lo + hi);
+        boundsRadius = 0.5f * glm::length(hi - lo);
         
+        auto lodStart = chrono::steady_clock::now();
+        float maxError = LOD_MAX_ERROR * 2.0f * boundsRadius;
+        lodErrors.assign(LOD_LEVELS, 0.0f);
+        size_t triangles[LOD_LEVELS] = {};
+        for (unsigned int i = 0; i < staged.size(); i++) {
+            StagedMesh &mesh = staged[i];
+            const Vertex *vertices = mesh.vertexData ? mesh.vertexData : mesh.vertices.data();
+            size_t vertexCount = mesh.vertexData ? mesh.vertexCount : mesh.vertices.size();
+            const unsigned int *indices = mesh.vertexData ? mesh.indexData : mesh.indices.data();
+            size_t indexCount = mesh.vertexData ? mesh.indexCount : mesh.indices.size();
+            triangles[0] += indexCount / 3;
+            
+            float error = 0.0f;
+            for (unsigned int l = 1; l < LOD_LEVELS; l++) {
+                float levelError = 0.0f;
+                mesh.lodIndices.push_back(mesh_simplifier::simplify(vertices, vertexCount, indices, indexCount,
+                                                                    indexCount / 6 * 3, maxError, &levelError));
+                // collapses leave holes in the cache order of the level before
+                index_optimizer::optimizeVertexCache(mesh.lodIndices.back().data(), mesh.lodIndices.back().size(), vertexCount);
+                // errors of the chain add up at worst
+                error += levelError;
+                mesh.lodErrors.push_back(error);
+                lodErrors[l] = std::max(lodErrors[l], error);
+                indices = mesh.lodIndices.back().data();
+                indexCount = mesh.lodIndices.back().size();
+                triangles[l] += indexCount / 3;
+            }
+        }
+        if (!importReport) {
+            return;
+        }
+        cout << "levels of detail:";
+        for (unsigned int l = 0; l < LOD_LEVELS; l++) {
+            cout << " " << triangles[l] << (l == 0 ? "" : " (" + to_string(lodErrors[l]) + ")");
+        }
+        cout << " triangles, built in " << chrono::duration<double, milli>(chrono::steady_clock::now() - lodStart).count() << " ms" << endl;
+    }
+    
+    // cuts the full detail index list of every staged mesh into clusters (see Meshlets.h) and ties each cluster of a
+    // skinned mesh to the bone most of its weight is on, so its bounds can follow the pose. runs at the end of import()
+    void buildClusters()
+    {
+        size_t clusters = 0, rigid = 0;
+        vector<float> weights(MAX_BONES);
+        for (unsigned int i = 0; i < staged.size(); i++) {
+            StagedMesh &mesh = staged[i];
+            const Vertex *vertices = mesh.vertexData ? mesh.vertexData : mesh.vertices.data();
+            const unsigned int *indices = mesh.vertexData ? mesh.indexData : mesh.indices.data();
+            size_t indexCount = mesh.vertexData ? mesh.indexCount : mesh.indices.size();
+            mesh.clusters = meshlets::build(indices, indexCount, [vertices](unsigned int v) { return vertices[v].Position; });
+            clusters += mesh.clusters.size();
+            if (!isAnimated) {
+                continue;
+            }
+            for (unsigned int c = 0; c < mesh.clusters.size(); c++) {
+                meshlets::Meshlet &cluster = mesh.clusters[c];
+                const unsigned int *first = indices + cluster.firstIndex;
+                std::fill(weights.begin(), weights.end(), 0.0f);
+                for (unsigned int k = 0; k < cluster.indexCount; k++) {
+                    const Vertex &v = vertices[first[k]];
+                    for (int b = 0; b < MAX_BONES_VERTEX; b++) {
+                        if (v.boneWeights[b] > 0.0f && v.boneIds[b] >= 0 && v.boneIds[b] < MAX_BONES) {
+                            weights[v.boneIds[b]] += v.boneWeights[b];
+                        }
+                    }
+                }
+                size_t bone = std::max_element(weights.begin(), weights.end()) - weights.begin();
+                if (weights[bone] <= 0.0f) {
+                    continue;
+                }
+                cluster.bone = (int)bone;
+                for (unsigned int k = 0; cluster.rigid && k < cluster.indexCount; k++) {
+                    cluster.rigid = mesh_simplifier::boneWeight(vertices[first[k]], cluster.bone) >= CLUSTER_RIGID_WEIGHT;
+                }
+                rigid += cluster.rigid ? 1 : 0;
+            }
+        }
+        if (!importReport) {
+            return;
+        }
+        cout << clusters << " clusters";
         if (isAnimated) {
-            animDuration = scene->mAnimations[1]->mDuration;
-            animTicks = scene->mAnimations[1]->mTicksPerSecond;
+            cout << ", " << rigid << " moving rigidly with one bone";
+        }
+        cout << endl;
+    }
+    
+    // sorts the meshes into batches with identical textures and uploads their draw commands
+    void buildDrawCommands()
+    {
+        vector<vector<unsigned int>> batchMeshes;
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            unsigned int b = 0;
+            for (; b < batchMeshes.size(); b++) {
+                const vector<Texture> &a = meshes[batchMeshes[b][0]].textures;
+                const vector<Texture> &t = meshes[i].textures;
+                bool same = a.size() == t.size();
+                for (unsigned int k = 0; same && k < a.size(); k++) {
+                    same = a[k].id == t[k].id && a[k].type == t[k].type;
+                }
+                if (same) {
+                    break;
+                }
+            }
+            if (b == batchMeshes.size()) {
+                batchMeshes.push_back(vector<unsigned int>());
+            }
+            batchMeshes[b].push_back(i);
+        }
+
+        drawCommands.clear();
+        drawBatches.clear();
+        commandMeshes.clear();
+        for (unsigned int lod = 0; lod < LOD_LEVELS; lod++) {
+            for (unsigned int b = 0; b < batchMeshes.size(); b++) {
+                if (lod == 0) {
+                    DrawBatch batch = {batchMeshes[b][0], drawCommands.size(), batchMeshes[b].size()};
+                    drawBatches.push_back(batch);
+                    commandMeshes.insert(commandMeshes.end(), batchMeshes[b].begin(), batchMeshes[b].end());
+                }
+                for (unsigned int i = 0; i < batchMeshes[b].size(); i++) {
+                    drawCommands.push_back(meshes[batchMeshes[b][i]].drawCommand(lod));
+                }
+            }
         }
         
+        clusterStart.clear();
+        size_t clusters = 0;
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            clusterStart.push_back(clusters);
+            clusters += meshes[i].clusters.size();
+        }
+        clusterBounds.resize(clusters);
+        clusterVisible.assign(clusterBounds.padded(), 1);
+        visibleBatches = drawBatches;
+
+        if (GLAD_GL_VERSION_4_3 && !drawCommands.empty()) {
+            glGenBuffers(1, &commandBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, drawCommands.size() * sizeof(DrawElementsIndirectCommand), drawCommands.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            if (clusters > 0) {
+                glGenBuffers(1, &visibleCommandBuffer);
+            }
+        }
+    }
+    
+    // moves the bounds of every cluster into world space with the pose of the last updatePose, culls them against
+    // the camera and collects the commands that draw the visible ones. runs of visible clusters in the index
+    // list share a command
+    void cullClusters()
+    {
+        glm::vec4 planes[6];
+        meshlets::frustumPlanes(cameraClip, planes);
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            const vector<meshlets::Meshlet> &clusters = meshes[i].clusters;
+            for (size_t k = 0; k < clusters.size(); k++) {
+                const meshlets::Meshlet &cluster = clusters[k];
+                glm::mat4 transform = cluster.bone >= 0 ? model * animationTransforms[cluster.bone] : model;
+                glm::mat3 basis(transform);
+                float scale = std::max(glm::length(basis[0]), std::max(glm::length(basis[1]), glm::length(basis[2])));
+                glm::vec3 center = glm::vec3(transform * glm::vec4(cluster.center, 1.0f));
+                if (cluster.rigid) {
+                    clusterBounds.set(clusterStart[i] + k, center, cluster.radius * scale, glm::normalize(basis * cluster.coneAxis),
+                                      cullBackFacing ? cluster.coneCutoff : 1.0f);
+                }
+                else {
+                    // the blend can bend the cluster, its normals can point anywhere
+                    clusterBounds.set(clusterStart[i] + k, center, cluster.radius * scale * CLUSTER_BLEND_SLACK, cluster.coneAxis, 1.0f);
+                }
+            }
+        }
+        meshlets::cull(clusterBounds, planes, cameraPosition, clusterVisible.data());
+        
+        visibleCommands.clear();
+        drawnClusters = 0;
+        for (unsigned int b = 0; b < drawBatches.size(); b++) {
+            size_t first = visibleCommands.size();
+            for (size_t n = 0; n < drawBatches[b].commandCount; n++) {
+                unsigned int i = commandMeshes[drawBatches[b].firstCommand + n];
+                const Mesh &mesh = meshes[i];
+                for (size_t k = 0; k < mesh.clusters.size(); k++) {
+                    if (!clusterVisible[clusterStart[i] + k]) {
+                        continue;
+                    }
+                    drawnClusters++;
+                    const meshlets::Meshlet &cluster = mesh.clusters[k];
+                    GLuint firstIndex = mesh.lods[0].firstIndex + cluster.firstIndex;
+                    DrawElementsIndirectCommand *last = visibleCommands.size() > first ? &visibleCommands.back() : nullptr;
+                    if (last && last->baseVertex == mesh.range.baseVertex && last->firstIndex + last->count == firstIndex) {
+                        last->count += cluster.indexCount;
+                    }
+                    else {
+                        DrawElementsIndirectCommand command = {cluster.indexCount, 1, firstIndex, mesh.range.baseVertex, 0};
+                        visibleCommands.push_back(command);
+                    }
+                }
+            }
+            visibleBatches[b].firstCommand = first;
+            visibleBatches[b].commandCount = visibleCommands.size() - first;
+        }
+        
+        if (visibleCommandBuffer && !visibleCommands.empty()) {
+            // respecified every draw, so the driver can hand out fresh storage instead of waiting on the last frame's
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, visibleCommandBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, visibleCommands.size() * sizeof(DrawElementsIndirectCommand), visibleCommands.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+    }
+
+    // draws every mesh at the current level of detail from the arena VAO given, one multi draw per texture batch.
+    // at full detail with a camera set only the visible clusters are drawn
+    void submit(Shader *shader, unsigned int vao)
+    {
+        bool culled = clusterCulling && hasCamera && currentLod == 0 && clusterBounds.count > 0;
+        if (culled) {
+            cullClusters();
+        }
+        else {
+            drawnClusters = clusterBounds.count;
+        }
+        const vector<DrawElementsIndirectCommand> &commands = culled ? visibleCommands : drawCommands;
+        const vector<DrawBatch> &batches = culled ? visibleBatches : drawBatches;
+        size_t lodOffset = culled ? 0 : std::min<size_t>(currentLod, LOD_LEVELS - 1) * meshes.size();
+        unsigned int buffer = culled ? visibleCommandBuffer : commandBuffer;
+        
+        GLState::instance().bindVertexArray(vao);
+        if (buffer) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+        }
+        for (unsigned int b = 0; b < batches.size(); b++) {
+            if (batches[b].commandCount == 0) {
+                continue;
+            }
+            meshes[batches[b].mesh].bindTextures(shader);
+            GeometryArena::multiDraw(commands, lodOffset + batches[b].firstCommand, batches[b].commandCount);
+        }
+        if (buffer) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+    }
+    
+    // send the current pose to the AnimationBlock, in whichever layout this model skins with
+    // the handles of shader's uniforms, looked up when the model first draws with it. the animation block is
+    // pointed at binding 0 then too, the binding is part of the program
+    const DrawUniforms &drawUniformsFor(Shader *shader) {
+        for (const DrawUniforms &uniforms : drawUniforms) {
+            if (uniforms.program == shader->ID) {
+                return uniforms;
+            }
+        }
+        DrawUniforms uniforms;
+        uniforms.program = shader->ID;
+        uniforms.model = shader->uniform("model");
+        GLuint animationBlock = shader->uniformBlock("AnimationBlock");
+        if (animationBlock != GL_INVALID_INDEX) {
+            glUniformBlockBinding(shader->ID, animationBlock, 0);
+        }
+        drawUniforms.push_back(uniforms);
+        return drawUniforms.back();
+    }
+    
+    void uploadPalette() {
+        glBindBuffer(GL_UNIFORM_BUFFER, ABO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, palette.byteSize(), palette.data.data());
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0, ABO);
     }
     
     void accumulateTransforms(shared_ptr<Bone> bone, glm::mat4 parentTransform, glm::mat4 invBind, double time) {
         glm::mat4 globalTrans = parentTransform * bone->getTransform(time);
         
-        animationTransforms[bone->loc] = invBind * globalTrans * bone->boneOffset;
+        // non bone nodes have no slot of their own, writing them would clobber bone 0
+        if (bone->isBone) {
+            animationTransforms[bone->loc] = invBind * globalTrans * bone->boneOffset;
+            palette.set(bone->loc, animationTransforms[bone->loc]);
+        }
         
         for (int i=0; i < bone->children.size(); i++) {
             accumulateTransforms(bone->children[i], globalTrans, invBind, time);
         }
     }
     
-    void setOffsetMatrix(shared_ptr<Bone> bone, int loc, glm::mat4 offset) {
-        if (bone->loc == loc) {
-            bone->boneOffset = offset;
+    // orders the triangles of a converted mesh for the vertex cache, then by cluster against overdraw, then the
+    // vertices by first use, and stages it for upload(). meshCount is how many meshes the file has, for the progress
+    void stageMesh(vector<Vertex> &&vertices, vector<unsigned int> &&indices, vector<Texture> &&textures, size_t meshCount)
+    {
+        size_t vertexCount = vertices.size();
+        cacheMissesBefore += index_optimizer::cacheMisses(indices.data(), indices.size(), vertexCount);
+        index_optimizer::optimizeVertexCache(indices.data(), indices.size(), vertexCount);
+        index_optimizer::optimizeOverdraw(indices.data(), indices.size(), vertices.data(), vertexCount);
+        index_optimizer::optimizeVertexFetch(vertices, indices);
+        cacheMissesAfter += index_optimizer::cacheMisses(indices.data(), indices.size(), vertices.size());
+        cacheTriangles += indices.size() / 3;
+
+        // stage the extracted mesh data, upload() creates the mesh from it
+        staged.emplace_back();
+        staged.back().vertices = std::move(vertices);
+        staged.back().indices = std::move(indices);
+        staged.back().textures = std::move(textures);
+        // the last few percent are left for freeing the scene and building the levels of detail
+        importFraction = 0.95f * std::min(1.0f, (float)staged.size() / std::max<size_t>(1, meshCount));
+    }
+    
+    void printImportStats() const
+    {
+        if (!importReport) {
+            return;
         }
-        else {
-            for (int i=0; i < bone->children.size(); i++) {
-                setOffsetMatrix(bone->children[i], loc, offset);
+        if (cacheTriangles > 0) {
+            cout << "vertex cache ACMR (FIFO " << index_optimizer::REPORT_CACHE_SIZE << "): " << (float)cacheMissesBefore / cacheTriangles
+                 << " as imported, " << (float)cacheMissesAfter / cacheTriangles << " optimized" << endl;
+        }
+        if (isAnimated) {
+            cout << "skeleton import: " << skeletonMs << " ms for " << numBones << " bones, " << skinWeightCount << " weights" << endl;
+        }
+    }
+    
+    // loads a glTF 2.0 file without assimp (see GltfLoader.h): its meshes, material textures, skin and animation clip,
+    // converted the way loadModel converts them through assimp. clip is as in import(). false, before anything
+    // is loaded, if the file can't be read this way
+    bool loadGltf(string const &path, string const &clip)
+    {
+        gltf::Document document;
+        if (!document.open(path)) {
+            return false;
+        }
+        const json::Value &root = document.root();
+        const json::Value &nodes = root["nodes"];
+        
+        // parent of every node, and the nodes with meshes in the depth first order assimp's node walk visits them
+        vector<int> parents(nodes.size(), -1);
+        for (size_t i = 0; i < nodes.size(); i++) {
+            const json::Value &children = nodes[i]["children"];
+            for (size_t c = 0; c < children.size(); c++) {
+                int child = children[c].asInt();
+                if (child >= 0 && child < (int)nodes.size()) {
+                    parents[child] = (int)i;
+                }
+            }
+        }
+        vector<int> meshNodes;
+        vector<int> pending;
+        const json::Value &sceneRoots = root["scenes"][root["scene"].asInt(0)]["nodes"];
+        for (size_t i = sceneRoots.size(); i > 0; i--) {
+            pending.push_back(sceneRoots[i - 1].asInt());
+        }
+        while (!pending.empty()) {
+            int node = pending.back();
+            pending.pop_back();
+            if (node < 0 || node >= (int)nodes.size()) {
+                continue;
+            }
+            if (nodes[node].has("mesh")) {
+                meshNodes.push_back(node);
+            }
+            const json::Value &children = nodes[node]["children"];
+            for (size_t c = children.size(); c > 0; c--) {
+                pending.push_back(children[c - 1].asInt());
+            }
+        }
+        size_t primitiveCount = 0;
+        int skin = -1;
+        for (unsigned int i = 0; i < meshNodes.size(); i++) {
+            primitiveCount += root["meshes"][nodes[meshNodes[i]]["mesh"].asInt()]["primitives"].size();
+            if (skin < 0) {
+                skin = nodes[meshNodes[i]]["skin"].asInt();
+            }
+        }
+        if (isAnimated && (skin < 0 || root["skins"][skin]["joints"].size() == 0 || root["animations"].size() == 0)) {
+            cout << "ERROR::GLTF:: " << path << " has no skinned mesh and animation to animate" << endl;
+            return false;
+        }
+        directory = document.directory;
+        
+        // skin joint -> bone ID
+        vector<int> jointBones;
+        if (isAnimated) {
+            inverseBindTransform = glm::mat4(1.0f);
+            auto skeletonStart = chrono::steady_clock::now();
+            loadGltfSkeleton(document, skin, parents, clip, jointBones);
+            skeletonMs += chrono::duration<double, milli>(chrono::steady_clock::now() - skeletonStart).count();
+        }
+        
+        staged.reserve(primitiveCount);
+        for (unsigned int i = 0; i < meshNodes.size(); i++) {
+            const json::Value &primitives = root["meshes"][nodes[meshNodes[i]]["mesh"].asInt()]["primitives"];
+            // joints are only valid with the skin the node binds
+            bool skinned = isAnimated && nodes[meshNodes[i]]["skin"].asInt() == skin;
+            for (size_t p = 0; p < primitives.size(); p++) {
+                loadGltfPrimitive(document, primitives[p], skinned ? &jointBones : nullptr, primitiveCount);
             }
         }
+        printImportStats();
+        return true;
     }
     
-    shared_ptr<Bone> processBoneNode(aiNode *node, const aiScene *scene) {
-        // TODO change from hardcoded 1 to search for flying animation? or take it as a parameter?
-        aiNodeAnim* boneChannel = nullptr;
+    // builds the bone tree from the skin's root joint (its skeleton, or the joints' closest common ancestor) with
+    // the keys of the named clip (the last one if there is no such clip), the nodes that clip animates being the bones.
+    // fills jointBones with the bone ID of every joint, -1 for joints that aren't bones
+    void loadGltfSkeleton(const gltf::Document &document, int skinIndex, const vector<int> &parents, string const &clipName,
+                          vector<int> &jointBones)
+    {
+        const json::Value &root = document.root();
+        const json::Value &nodes = root["nodes"];
+        const json::Value &skin = root["skins"][skinIndex];
+        const json::Value &joints = skin["joints"];
+        
+        int top = skin["skeleton"].asInt();
+        if (top >= (int)nodes.size()) {
+            top = -1;
+        }
+        if (top < 0) {
+            top = joints[0].asInt();
+            for (size_t j = 1; j < joints.size(); j++) {
+                int ancestor = joints[j].asInt();
+                while (ancestor >= 0 && ancestor != top) {
+                    ancestor = parents[ancestor];
+                }
+                if (ancestor < 0 && parents[top] >= 0) {
+                    // not below top, move up and check the joint again
+                    top = parents[top];
+                    j--;
+                }
+            }
+        }
+        
+        const json::Value &animations = root["animations"];
+        int clip = (int)animations.size() - 1;
+        for (size_t a = 0; a < animations.size(); a++) {
+            if (animations[a]["name"].asString() == clipName) {
+                clip = (int)a;
+            }
+        }
+        const json::Value &animation = animations[clip];
+        // sampler of each node's translation, scale and rotation
+        vector<std::array<int, 3>> channels(nodes.size(), std::array<int, 3>{{-1, -1, -1}});
+        const json::Value &channelList = animation["channels"];
+        for (size_t c = 0; c < channelList.size(); c++) {
+            const json::Value &target = channelList[c]["target"];
+            int node = target["node"].asInt();
+            const string &targetPath = target["path"].asString();
+            int slot = targetPath == "translation" ? 0 : targetPath == "scale" ? 1 : targetPath == "rotation" ? 2 : -1;
+            if (node >= 0 && node < (int)nodes.size() && slot >= 0) {
+                channels[node][slot] = channelList[c]["sampler"].asInt();
+            }
+        }
+        
+        // joints the clip leaves alone still get bones, so the weights on them are kept
+        vector<unsigned char> jointNodes(nodes.size(), 0);
+        for (size_t j = 0; j < joints.size(); j++) {
+            int node = joints[j].asInt();
+            if (node >= 0 && node < (int)nodes.size()) {
+                jointNodes[node] = 1;
+            }
+        }
+        vector<int> nodeBones(nodes.size(), -1);
+        animDuration = 0.0f;
+        animTicks = (float)gltf::TICKS_PER_SECOND;
+        boneRoot = loadGltfBone(document, animation, top, channels, jointNodes, nodeBones);
+        boneRoot->boneOffset = glm::mat4(1.0f);
+        
+        gltf::Accessor inverseBind = document.accessor(skin["inverseBindMatrices"].asInt());
+        jointBones.assign(joints.size(), -1);
+        for (size_t j = 0; j < joints.size(); j++) {
+            int node = joints[j].asInt();
+            if (node < 0 || node >= (int)nodes.size() || nodeBones[node] < 0) {
+                continue;
+            }
+            jointBones[j] = nodeBones[node];
+            bonesByLoc[nodeBones[node]]->boneOffset = inverseBind.valid() && j < inverseBind.count ? inverseBind.mat4(j) : glm::mat4(1.0f);
+        }
+    }
+    
+    // the bone tree below node, joints and nodes with an animation channel become bones
+    shared_ptr<Bone> loadGltfBone(const gltf::Document &document, const json::Value &animation, int node,
+                                  const vector<std::array<int, 3>> &channels, const vector<unsigned char> &jointNodes, vector<int> &nodeBones)
+    {
+        const json::Value &source = document.root()["nodes"][node];
         std::shared_ptr<Bone> bone = make_shared<Bone>();
+        bone->name = source["name"].asString();
+        bone->isBone = jointNodes[node] || channels[node][0] >= 0 || channels[node][1] >= 0 || channels[node][2] >= 0;
+        if (bone->isBone && numBones < MAX_BONES) {
+            bone->loc = numBones;
+            boneIdMap.insert(make_pair(bone->name, bone->loc));
+            bonesByLoc.push_back(bone);
+            nodeBones[node] = numBones;
+            numBones++;
+            
+            // paths the clip doesn't animate keep the node's own value, as a single key like assimp adds
+            const json::Value &t = source["translation"], &s = source["scale"], &r = source["rotation"];
+            glm::vec3 translation(t[0].asNumber(0.0), t[1].asNumber(0.0), t[2].asNumber(0.0));
+            glm::vec3 scale(s[0].asNumber(1.0), s[1].asNumber(1.0), s[2].asNumber(1.0));
+            glm::quat rotation(r[3].asNumber(1.0), r[0].asNumber(0.0), r[1].asNumber(0.0), r[2].asNumber(0.0));
+            loadGltfKeys(document, animation, channels[node][0], bone->positionKeys, translation,
+                         [](const gltf::Accessor &values, size_t i) { return values.vec3(i); });
+            loadGltfKeys(document, animation, channels[node][1], bone->scaleKeys, scale,
+                         [](const gltf::Accessor &values, size_t i) { return values.vec3(i); });
+            loadGltfKeys(document, animation, channels[node][2], bone->rotationKeys, rotation,
+                         [](const gltf::Accessor &values, size_t i) { glm::vec4 q = values.vec4(i); return glm::quat(q.w, q.x, q.y, q.z); });
+        }
+        else {
+            bone->isBone = false;
+        }
+        
+        const json::Value &children = source["children"];
+        for (size_t c = 0; c < children.size(); c++) {
+            if (children[c].asInt() < 0 || children[c].asInt() >= (int)channels.size()) {
+                continue;
+            }
+            bone->children.push_back(loadGltfBone(document, animation, children[c].asInt(), channels, jointNodes, nodeBones));
+        }
+        return bone;
+    }
+    
+    // the keys of one sampler, times in ticks. cubic spline samplers store in tangent, value, out tangent per key,
+    // only the values are kept since Bone interpolates linearly
+    template<typename T, typename Read>
+    void loadGltfKeys(const gltf::Document &document, const json::Value &animation, int sampler, std::map<double, T> &keys, T rest, Read read)
+    {
+        const json::Value &source = animation["samplers"][sampler];
+        gltf::Accessor times = document.accessor(source["input"].asInt());
+        gltf::Accessor values = document.accessor(source["output"].asInt());
+        if (sampler < 0 || !times.valid() || !values.valid()) {
+            keys.emplace(0.0, rest);
+            return;
+        }
+        bool cubic = source["interpolation"].asString() == "CUBICSPLINE";
+        size_t count = std::min(times.count, cubic ? values.count / 3 : values.count);
+        for (size_t k = 0; k < count; k++) {
+            double time = times.get(k, 0) * gltf::TICKS_PER_SECOND;
+            // keys come sorted by time, hinting the end makes each insert constant time
+            keys.emplace_hint(keys.end(), time, read(values, cubic ? k * 3 + 1 : k));
+            animDuration = std::max(animDuration, (float)time);
+        }
+    }
+    
+    // converts a triangle list primitive into a staged mesh, reading every attribute straight from the mapped buffers.
+    // jointBones maps the skin's joints to bone IDs, nullptr for meshes that aren't skinned
+    void loadGltfPrimitive(const gltf::Document &document, const json::Value &primitive, const vector<int> *jointBones, size_t primitiveCount)
+    {
+        const json::Value &attributes = primitive["attributes"];
+        gltf::Accessor positions = document.accessor(attributes["POSITION"].asInt());
+        if (primitive["mode"].asInt(gltf::MODE_TRIANGLES) != gltf::MODE_TRIANGLES || !positions.valid()) {
+            cout << "ERROR::GLTF:: skipping a primitive that is not a triangle list with positions" << endl;
+            return;
+        }
+        size_t vertexCount = positions.count;
+        // attributes that are missing or don't match the positions read as invalid
+        auto attribute = [&](const char *name) {
+            gltf::Accessor accessor = document.accessor(attributes[name].asInt());
+            return accessor.count == vertexCount ? accessor : gltf::Accessor();
+        };
+        gltf::Accessor normals = attribute("NORMAL");
+        gltf::Accessor texCoords = attribute("TEXCOORD_0");
+        gltf::Accessor tangents = attribute("TANGENT");
+        gltf::Accessor joints = attribute("JOINTS_0");
+        gltf::Accessor weights = attribute("WEIGHTS_0");
+        bool skinned = jointBones && joints.valid() && weights.valid();
+        
+        vector<Vertex> vertices(vertexCount);
+        size_t droppedWeights = 0;
+        for (size_t i = 0; i < vertexCount; i++) {
+            Vertex &vertex = vertices[i];
+            vertex.Position = positions.vec3(i);
+            vertex.Normal = normals.valid() ? normals.vec3(i) : glm::vec3(0.0f);
+            vertex.TexCoords = texCoords.valid() ? texCoords.vec2(i) : glm::vec2(0.0f);
+            if (tangents.valid()) {
+                glm::vec4 tangent = tangents.vec4(i);
+                vertex.Tangent = glm::vec3(tangent);
+                // w holds the handedness of the tangent frame
+                vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent) * tangent.w;
+            }
+            if (!skinned) {
+                continue;
+            }
+            for (int k = 0; k < 4; k++) {
+                float weight = weights.get(i, k);
+                if (weight <= 0.0f || vertex.numBones >= MAX_BONES_VERTEX) {
+                    continue;
+                }
+                unsigned int joint = joints.index(i, k);
+                int bone = joint < jointBones->size() ? (*jointBones)[joint] : -1;
+                if (bone < 0) {
+                    droppedWeights++;
+                    continue;
+                }
+                vertex.boneWeights[vertex.numBones] = weight;
+                vertex.boneIds[vertex.numBones] = bone;
+                vertex.numBones += 1;
+                skinWeightCount++;
+            }
+        }
+        if (droppedWeights > 0) {
+            cout << "ERROR::GLTF:: " << droppedWeights << " weights on joints outside the skeleton dropped" << endl;
+        }
+        
+        vector<unsigned int> indices;
+        gltf::Accessor indexAccessor = document.accessor(primitive["indices"].asInt());
+        if (indexAccessor.valid()) {
+            indices.resize(indexAccessor.count / 3 * 3);
+            for (size_t i = 0; i < indices.size(); i++) {
+                indices[i] = std::min<unsigned int>(indexAccessor.index(i), (unsigned int)vertexCount - 1);
+            }
+        }
+        else {
+            indices.resize(vertexCount / 3 * 3);
+            for (size_t i = 0; i < indices.size(); i++) {
+                indices[i] = (unsigned int)i;
+            }
+        }
+        if (!tangents.valid()) {
+            gltf::generateTangents(vertices, indices);
+        }
+        
+        // the same texture slots assimp maps glTF materials to
+        vector<Texture> textures;
+        const json::Value &material = document.root()["materials"][primitive["material"].asInt()];
+        auto addTexture = [&](const json::Value &reference, const char *typeName) {
+            string texturePath = reference.has("index") ? document.texturePath(reference["index"].asInt()) : string();
+            if (!texturePath.empty()) {
+                textures.push_back({0, typeName, texturePath});
+            }
+        };
+        addTexture(material["pbrMetallicRoughness"]["baseColorTexture"], "texture_diffuse");
+        addTexture(material["normalTexture"], "texture_normal");
+        addTexture(material["pbrMetallicRoughness"]["metallicRoughnessTexture"], "texture_pbr");
         
-        for (int i=0; i < scene->mAnimations[1]->mNumChannels; i++) {
-            if (scene->mAnimations[1]->mChannels[i]->mNodeName == node->mName) {
-                boneChannel = scene->mAnimations[1]->mChannels[i];
+        stageMesh(std::move(vertices), std::move(indices), std::move(textures), primitiveCount);
+    }
+    
+#ifndef TOOTHLESS_NO_ASSIMP
+    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // the importer and its scene only live for the duration of the load, everything used at runtime
+    // is converted into meshes, bones and keys first. clip is as in import()
+    bool loadModel(string const &path, string const &clip)
+    {
+        // read file via ASSIMP
+        Assimp::Importer importer;
+        const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        // check for errors
+        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        {
+            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            return false;
+        }
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        // the named clip, the last one if there is no such clip
+        const aiAnimation *animation = scene->mNumAnimations ? scene->mAnimations[scene->mNumAnimations - 1] : nullptr;
+        for (unsigned int a = 0; a < scene->mNumAnimations; a++) {
+            if (clip == scene->mAnimations[a]->mName.C_Str()) {
+                animation = scene->mAnimations[a];
             }
         }
+        if (isAnimated && !animation) {
+            cout << "ERROR::ASSIMP:: " << path << " has no animation" << endl;
+            return false;
+        }
+
+        // process ASSIMP's root node recursively, nodes usually reference each mesh once
+        staged.reserve(scene->mNumMeshes);
+        processNode(scene->mRootNode, scene, animation);
+        
+        if (isAnimated) {
+            animDuration = animation->mDuration;
+            animTicks = animation->mTicksPerSecond;
+        }
+
+        printImportStats();
+
+        // drop the imported scene now instead of keeping it next to our copies
+        size_t rssWithScene = importReport ? memory_stats::currentRss() : 0;
+        importer.FreeScene();
+        memory_stats::trimHeap();
+        if (importReport) {
+            cout << "released assimp scene of " << path << ": " << memory_stats::megabytes(rssWithScene) << " MB -> "
+                 << memory_stats::megabytes(memory_stats::currentRss()) << " MB RSS" << endl;
+        }
+        return true;
+    }
+    
+    // builds the bone tree below node, channels maps node names to their animation channel
+    shared_ptr<Bone> processBoneNode(aiNode *node, const std::unordered_map<std::string, const aiNodeAnim*> &channels) {
+        std::shared_ptr<Bone> bone = make_shared<Bone>();
+        bone->name = node->mName.C_Str();
+        
+        auto channel = channels.find(bone->name);
+        const aiNodeAnim* boneChannel = channel != channels.end() ? channel->second : nullptr;
         
         // this node is not a bone if its name is not in the mChannels animation list
         // but we still have to include it
         if (boneChannel != nullptr) {
             bone->loc = numBones;
-            boneIdMap.insert(make_pair((boneChannel->mNodeName.C_Str()), bone->loc));
+            boneIdMap.insert(make_pair(bone->name, bone->loc));
+            bonesByLoc.push_back(bone);
             numBones++;
             bone->isBone = true;
             
+            // keys come sorted by time, hinting the end makes each insert constant time
             aiVectorKey tmpKey;
             aiQuatKey tmpKeyQ;
             glm::vec3 tmpVec;
             for (int i=0; i < boneChannel->mNumPositionKeys; i++) {
                 tmpKey = boneChannel->mPositionKeys[i];
                 tmpVec = ai_converters::vec3_cast(tmpKey.mValue);
-                bone->positionKeys.insert(std::make_pair(tmpKey.mTime, tmpVec));
+                bone->positionKeys.emplace_hint(bone->positionKeys.end(), tmpKey.mTime, tmpVec);
             }
             for (int i=0; i < boneChannel->mNumScalingKeys; i++) {
                tmpKey = boneChannel->mScalingKeys[i];
                tmpVec = ai_converters::vec3_cast(tmpKey.mValue);
-               bone->scaleKeys.insert(std::make_pair(tmpKey.mTime, tmpVec));
+               bone->scaleKeys.emplace_hint(bone->scaleKeys.end(), tmpKey.mTime, tmpVec);
             }
             for (int i=0; i < boneChannel->mNumRotationKeys; i++) {
                 tmpKeyQ = boneChannel->mRotationKeys[i];
-                bone->rotationKeys.insert(std::make_pair(tmpKeyQ.mTime, ai_converters::quat_cast(tmpKeyQ.mValue)));
+                bone->rotationKeys.emplace_hint(bone->rotationKeys.end(), tmpKeyQ.mTime, ai_converters::quat_cast(tmpKeyQ.mValue));
             }
             
         }
@@ -253,7 +1603,7 @@ private:
         
         // add nodes children to our bone heirarchy
         for (int i=0; i<node->mNumChildren; i++) {
-            std::shared_ptr<Bone> tmpBone = processBoneNode(node->mChildren[i], scene);
+            std::shared_ptr<Bone> tmpBone = processBoneNode(node->mChildren[i], channels);
             if (tmpBone != nullptr) {
                 bone->children.push_back(tmpBone);
             }
@@ -263,7 +1613,7 @@ private:
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    void processNode(aiNode *node, const aiScene *scene, const aiAnimation *animation)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -271,22 +1621,25 @@ private:
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            processMesh(mesh, scene, animation);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, animation);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // converts an assimp mesh and stages it for upload(), animation is the clip its bones get their keys from
+    void processMesh(aiMesh *mesh, const aiScene *scene, const aiAnimation *animation)
     {
-        // data to fill
+        // data to fill, sized up front so nothing reallocates while it is filled
         vector<Vertex> vertices;
         vector<unsigned int> indices;
         vector<Texture> textures;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
 
         // Walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -331,6 +1684,9 @@ private:
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
             aiFace face = mesh->mFaces[i];
+            // triangulation leaves point and line faces as they are, only triangles are drawn
+            if (face.mNumIndices != 3)
+                continue;
             // retrieve all indices of the face and store them in the indices vector
             for(unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
@@ -345,20 +1701,15 @@ private:
         // normal: texture_normalN
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_NORMALS, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        loadMaterialTextures(material, aiTextureType_NORMALS, "texture_normal", textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
         // 4. PBR maps TODO fix
-        std::vector<Texture> pbrMaps = loadMaterialTextures(material, aiTextureType_UNKNOWN, "texture_pbr");
-        textures.insert(textures.end(), pbrMaps.begin(), pbrMaps.end());
+        loadMaterialTextures(material, aiTextureType_UNKNOWN, "texture_pbr", textures);
         
         if (isAnimated) {
             // first few nodes are not animations, skip to the animations
@@ -373,111 +1724,71 @@ private:
             //glm::rotate(identity, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));//
             inverseBindTransform = glm::inverse(inverseBindTransform);
             
-            // process bones
-            boneRoot = processBoneNode(animRoot, scene);
-            boneRoot->boneOffset = glm::mat4(1.0f);
+            auto skeletonStart = chrono::steady_clock::now();
+            // process bones, the skeleton is shared by every mesh so it is only built once
+            if (!boneRoot) {
+                // index the channels of the animation by node name once instead of scanning them per node
+                std::unordered_map<std::string, const aiNodeAnim*> channels;
+                channels.reserve(animation->mNumChannels);
+                for (unsigned int i = 0; i < animation->mNumChannels; i++) {
+                    channels.insert(make_pair(string(animation->mChannels[i]->mNodeName.C_Str()), animation->mChannels[i]));
+                }
+                boneRoot = processBoneNode(animRoot, channels);
+                boneRoot->boneOffset = glm::mat4(1.0f);
+            }
 
-            // walk through all bones in mesh and assign bone weights to vertices
+            // walk through all bones in mesh and assign bone weights to vertices.
+            // the bone's ID and offset are looked up once per bone, not once per weight
             aiBone *tempBone;
             Vertex *tempVert;
             for (int i=0; i < mesh->mNumBones; i++) {
                 tempBone = mesh->mBones[i];
+                auto it = boneIdMap.find(string(tempBone->mName.C_Str()));
+                if (it == boneIdMap.end()) {
+                    cout << "key not found: " << tempBone->mName.C_Str() << endl;
+                    continue;
+                }
+                int id = it->second;
+                // set offset matrix
+                bonesByLoc[id]->boneOffset = ai_converters::mat4_cast(tempBone->mOffsetMatrix);
                 for (int j=0; j < tempBone->mNumWeights; j++) {
-                    if (tempBone->mWeights[j].mWeight > 0){
-                        tempVert = &vertices[tempBone->mWeights[j].mVertexId];
+                    tempVert = &vertices[tempBone->mWeights[j].mVertexId];
+                    if (tempBone->mWeights[j].mWeight > 0 && tempVert->numBones < MAX_BONES_VERTEX){
                         // add bone to vertex
                         tempVert->boneWeights[tempVert->numBones] = tempBone->mWeights[j].mWeight;
-                        auto it = boneIdMap.find(string(tempBone->mName.C_Str()));
-                        if (it == boneIdMap.end()) {
-                            cout << "key not found: " << tempBone->mName.C_Str() << endl;
-                        }
-                        else {
-                            tempVert->boneIds[tempVert->numBones] = it->second;
-                            // set offset matrix
-                            setOffsetMatrix(boneRoot, it->second, ai_converters::mat4_cast(tempBone->mOffsetMatrix));
-                        }
+                        tempVert->boneIds[tempVert->numBones] = id;
                         tempVert->numBones += 1;
+                        skinWeightCount++;
                     }
                 }
             }
+            skeletonMs += chrono::duration<double, milli>(chrono::steady_clock::now() - skeletonStart).count();
         }
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // after the bone weights, which address assimp's vertex order
+        stageMesh(std::move(vertices), std::move(indices), std::move(textures), scene->mNumMeshes);
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
+    // appends the material's textures of a given type to textures, upload() loads them
     //TODO extend to PBR with #include <assimp/pbrmaterial.h>
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    void loadMaterialTextures(aiMaterial *mat, aiTextureType type, string const &typeName, vector<Texture> &textures)
     {
-        vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back({0, typeName, str.C_Str()});
         }
-        return textures;
     }
+#endif
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma, glm::u8vec4 placeholder)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    // decoded on the loader's threads and uploaded over the next frames, see TextureLoader::pump
+    return TextureCache::instance().acquire(filename, placeholder);
 }
 #endif
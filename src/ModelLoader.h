@@ -0,0 +1,202 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include "Model.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// where a model requested from the ModelLoader is
+enum Model_Load_State {
+    MODEL_QUEUED,       // waiting for the import thread
+    MODEL_IMPORTING,    // being read and converted on the import thread
+    MODEL_UPLOADING,    // imported, its meshes and textures go up over the next frames
+    MODEL_READY,        // complete, can be drawn
+    MODEL_FAILED        // the file could not be loaded
+};
+
+// a model being loaded by the ModelLoader, shared by whoever asked for it and the loader
+class ModelHandle
+{
+public:
+    Model_Load_State state() const { return currentState.load(); }
+    bool ready() const { return state() == MODEL_READY; }
+    bool failed() const { return state() == MODEL_FAILED; }
+
+    // 0 to 1 over the whole load, importing is the first half and uploading the second
+    float progress() const
+    {
+        switch (state()) {
+            case MODEL_QUEUED:
+                return 0.0f;
+            case MODEL_IMPORTING:
+                return 0.5f * loaded->importProgress();
+            case MODEL_UPLOADING:
+                return 0.5f + 0.5f * loaded->uploadProgress();
+            default:
+                return 1.0f;
+        }
+    }
+
+    // the model, owned by the handle. it exists from the start so its flight state can be used right away,
+    // everything that touches its meshes, skeleton or GL objects has to wait for ready()
+    Model *model() const { return loaded.get(); }
+
+    std::string const &path() const { return sourcePath; }
+
+private:
+    friend class ModelLoader;
+    std::string sourcePath;
+    std::unique_ptr<Model> loaded;
+    std::atomic<Model_Load_State> currentState{MODEL_QUEUED};
+};
+
+// Loads models without blocking the render thread. load() hands back a handle at once; a background
+// thread imports the file (parsing, conversion to meshes and the skeleton, see Model::import), then
+// pump(), called once per frame, creates the textures and copies the meshes into the geometry arena a
+// budgeted number of bytes at a time (Model::upload). Texture images are decoded on the TextureLoader's
+// threads as usual.
+class ModelLoader
+{
+public:
+    // the loader used by the application
+    static ModelLoader &instance()
+    {
+        static ModelLoader loader;
+        return loader;
+    }
+
+    // queues path for import, takes the same settings as the Model constructor. call on the render thread
+    std::shared_ptr<ModelHandle> load(std::string const &path, bool gamma = false, bool animated = false,
+                                      Skinning_Mode skinning = SKINNING_LINEAR_BLEND, Vertex_Format vertexFormat = VERTEX_FULL,
+                                      Geometry_Retention retention = GEOMETRY_RELEASE)
+    {
+        std::shared_ptr<ModelHandle> handle = std::make_shared<ModelHandle>();
+        handle->sourcePath = path;
+        handle->loaded.reset(new Model(path, gamma, animated, skinning, vertexFormat, retention, LOAD_DEFERRED));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(handle);
+            outstanding++;
+        }
+        jobReady.notify_one();
+        return handle;
+    }
+
+    // uploads imported models, at most about byteBudget bytes of geometry this frame.
+    // meshes bigger than the budget go up in pieces over several frames
+    void pump(size_t byteBudget)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!imported.empty()) {
+                uploading.push_back(imported.front());
+                imported.pop_front();
+            }
+        }
+        if (uploading.empty()) {
+            return;
+        }
+        std::shared_ptr<ModelHandle> handle = uploading.front();
+        if (handle->loaded->upload(byteBudget)) {
+            handle->currentState = MODEL_READY;
+            uploading.pop_front();
+            std::lock_guard<std::mutex> lock(mutex);
+            outstanding--;
+        }
+    }
+
+    // true once every model requested so far is ready or has failed
+    bool idle()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return outstanding == 0;
+    }
+
+    // pumps without a budget until every queued model is loaded, for tools that need them complete
+    void finish()
+    {
+        while (!idle()) {
+            pump(SIZE_MAX);
+            std::this_thread::yield();
+        }
+    }
+
+    // stops the import thread and drops the loader's references to models still loading. call on the render
+    // thread before the GL context is destroyed, a model freed later would delete its buffers without one
+    void shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+        jobs.clear();
+        imported.clear();
+        uploading.clear();
+    }
+
+    ~ModelLoader()
+    {
+        shutdown();
+    }
+
+    ModelLoader(const ModelLoader &) = delete;
+    ModelLoader &operator=(const ModelLoader &) = delete;
+
+private:
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    std::deque<std::shared_ptr<ModelHandle>> jobs;
+    std::deque<std::shared_ptr<ModelHandle>> imported;
+    // render thread only
+    std::deque<std::shared_ptr<ModelHandle>> uploading;
+    int outstanding = 0;
+    bool stopping = false;
+    // last, so everything it uses is initialized before it starts
+    std::thread worker;
+
+    // imports are large and mostly allocation bound, one thread at a time is enough next to the texture workers
+    ModelLoader() : worker(&ModelLoader::work, this) {}
+
+    void work()
+    {
+        for (;;) {
+            std::shared_ptr<ModelHandle> handle;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping) {
+                    return;
+                }
+                handle = jobs.front();
+                jobs.pop_front();
+            }
+
+            handle->currentState = MODEL_IMPORTING;
+            bool loaded = handle->loaded->import(handle->sourcePath);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (loaded) {
+                handle->currentState = MODEL_UPLOADING;
+                imported.push_back(handle);
+            }
+            else {
+                std::cout << "ERROR::MODEL_LOADER:: failed to load " << handle->sourcePath << std::endl;
+                handle->currentState = MODEL_FAILED;
+                outstanding--;
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,170 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Linked programs saved with glGetProgramBinary and restored with glProgramBinary on the next launch,
+// which skips compiling and linking GLSL. Each program is a file in CACHE_DIRECTORY named after a 64 bit
+// hash of its sources (and defines) together with the driver's vendor, renderer and version strings,
+// so editing a shader or updating the driver just misses the cache. A binary the driver rejects is
+// deleted and the program is compiled from source as if it was never cached.
+//
+//   ProgramBinaryHeader
+//   binary[length]
+namespace program_cache {
+
+    const char *const CACHE_DIRECTORY = "./cache";
+    const char MAGIC[4] = {'T', 'F', 'P', 'B'};
+    const uint32_t VERSION = 1;
+
+    struct ProgramBinaryHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    // counts since launch, main reports them once the shaders are built
+    struct Stats {
+        unsigned int hits = 0;
+        unsigned int misses = 0;
+        double compileMs = 0.0;
+    };
+
+    inline Stats &stats()
+    {
+        static Stats stats;
+        return stats;
+    }
+
+    // false on contexts without program binaries (before GL 4.1) or without a format to save them in.
+    // Mesa only offers one with its on disk shader cache, otherwise every launch compiles
+    inline bool available()
+    {
+        if (!GLAD_GL_VERSION_4_1) {
+            return false;
+        }
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    // FNV-1a over the parts, each prefixed with its length so moving text between stages changes the key,
+    // and the strings that identify the driver
+    inline uint64_t key(const std::vector<std::string> &parts)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const char *data, size_t length) {
+            for (size_t b = 0; b < sizeof(uint64_t); b++) {
+                hash = (hash ^ (((uint64_t)length >> (8 * b)) & 0xFF)) * 1099511628211ull;
+            }
+            for (size_t i = 0; i < length; i++) {
+                hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+            }
+        };
+        for (const std::string &part : parts) {
+            mix(part.data(), part.size());
+        }
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION}) {
+            const char *text = (const char *)glGetString(name);
+            mix(text ? text : "", text ? strlen(text) : 0);
+        }
+        return hash;
+    }
+
+    inline std::string path(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return std::string(CACHE_DIRECTORY) + "/" + name;
+    }
+
+    // links program from the binary cached under key. false if there is none or the driver rejects it,
+    // program is then still unlinked and can be built from source
+    inline bool load(GLuint program, uint64_t key)
+    {
+        if (!available()) {
+            return false;
+        }
+        std::ifstream file(path(key), std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        ProgramBinaryHeader header;
+        if (!file.read((char *)&header, sizeof(header)) || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            header.version != VERSION || header.key != key) {
+            return false;
+        }
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), binary.size())) {
+            return false;
+        }
+        glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            // saved by a driver build that no longer accepts it
+            file.close();
+            remove(path(key).c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // asks the driver to keep program's binary retrievable, before it is linked
+    inline void prepare(GLuint program)
+    {
+        if (available()) {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+    }
+
+    // saves the binary of the linked program under key
+    inline void store(GLuint program, uint64_t key)
+    {
+        if (!available()) {
+            return;
+        }
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+        ProgramBinaryHeader header;
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.key = key;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &format, binary.data());
+        header.format = format;
+        header.length = (uint32_t)written;
+
+#ifdef _WIN32
+        _mkdir(CACHE_DIRECTORY);
+#else
+        mkdir(CACHE_DIRECTORY, 0755);
+#endif
+        std::ofstream file(path(key), std::ios::binary | std::ios::trunc);
+        if (!file.write((const char *)&header, sizeof(header)) || !file.write(binary.data(), written)) {
+            std::cout << "ERROR::PROGRAM_CACHE:: could not write " << path(key) << std::endl;
+        }
+    }
+}
+#endif
@@ -4,18 +4,48 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "GLSL.h"
+#include "GLState.h"
+#include "ProgramCache.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+// location of a uniform in one program, looked up once with Shader::uniform so setting it
+// costs no string work or driver query. invalid handles (the uniform isn't active) are ignored by the set calls
+struct UniformHandle
+{
+    GLint location = -1;
+    bool valid() const { return location >= 0; }
+};
+
+// GL_KHR_parallel_shader_compile, the ARB extension uses the same value
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
+// Programs are compiled and linked without waiting: the constructors submit the work and return, poll()
+// reports without blocking whether it is done, which the driver can tell with GL_KHR_parallel_shader_compile,
+// and the results are checked then (or by finish(), which waits). Build every program before polling any so
+// drivers that compile on threads work on all of them at once. A program has to be ready before its uniforms
+// are looked up, use() waits for it.
+// Options of a shader that change what code it runs are #ifdefs in its source, picked by passing defines
+// ("NAME" or "NAME value") which are inserted after the #version line, so each combination compiles to a
+// program of its own without the branches it doesn't take. ShaderVariants keeps the combinations of one source.
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor submits the shader for compiling, see poll(). defines go into every stage
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+           const std::vector<std::string> &defines = {})
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -41,8 +71,8 @@ public:
             vShaderFile.close();
             fShaderFile.close();
             // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            vertexCode = withDefines(vShaderStream.str(), defines);
+            fragmentCode = withDefines(fShaderStream.str(), defines);
             // if geometry shader path is present, also load a geometry shader
             if(geometryPath != nullptr)
             {
@@ -50,122 +80,335 @@ public:
                 std::stringstream gShaderStream;
                 gShaderStream << gShaderFile.rdbuf();
                 gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                geometryCode = withDefines(gShaderStream.str(), defines);
             }
         }
         catch (std::ifstream::failure e)
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        // a program linked from the same sources (and defines) on an earlier launch is restored without compiling
+        compileStart = std::chrono::steady_clock::now();
+        ID = glCreateProgram();
+        cacheKey = program_cache::key({vertexCode, fragmentCode, geometryCode});
+        if (program_cache::load(ID, cacheKey))
+        {
+            program_cache::stats().hits++;
+            reflectUniforms();
+            return;
+        }
+        // 2. submit the shaders and the link, finish() checks the results
+        compileStage(GL_VERTEX_SHADER, vertexCode);
+        compileStage(GL_FRAGMENT_SHADER, fragmentCode);
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
         if(geometryPath != nullptr)
+            compileStage(GL_GEOMETRY_SHADER, geometryCode);
+        program_cache::prepare(ID);
+        glLinkProgram(ID);
+        compiling = true;
+    }
+    // vertex shader only program whose outputs are captured with transform feedback instead of rasterized.
+    // the varyings are written interleaved, in the given order
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const std::vector<std::string> &feedbackVaryings, const std::vector<std::string> &defines = {})
+    {
+        std::string vertexCode;
+        std::ifstream vShaderFile;
+        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            vShaderFile.open(vertexPath);
+            std::stringstream vShaderStream;
+            vShaderStream << vShaderFile.rdbuf();
+            vShaderFile.close();
+            vertexCode = withDefines(vShaderStream.str(), defines);
+        }
+        catch (std::ifstream::failure e)
         {
-            const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
-        // shader Program
+        // the captured varyings are part of the program, so they are part of its cache key
+        compileStart = std::chrono::steady_clock::now();
         ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
+        std::vector<std::string> keyParts(1, vertexCode);
+        keyParts.insert(keyParts.end(), feedbackVaryings.begin(), feedbackVaryings.end());
+        cacheKey = program_cache::key(keyParts);
+        if (program_cache::load(ID, cacheKey))
+        {
+            program_cache::stats().hits++;
+            reflectUniforms();
+            return;
+        }
+        compileStage(GL_VERTEX_SHADER, vertexCode);
+        // varyings to capture have to be declared before linking
+        std::vector<const char*> varyings;
+        for (const std::string &name : feedbackVaryings)
+            varyings.push_back(name.c_str());
+        glTransformFeedbackVaryings(ID, (GLsizei)varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+        program_cache::prepare(ID);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        compiling = true;
+    }
+    // true once the program is linked and its uniforms reflected. doesn't check on the driver, poll() does
+    bool ready() const
+    {
+        return !compiling;
+    }
+    // checks whether the driver has finished compiling and linking without blocking, and finishes the program
+    // if so. without GL_KHR_parallel_shader_compile there is no way to ask, this waits like finish()
+    // ------------------------------------------------------------------------
+    bool poll()
+    {
+        if (compiling && parallelCompile())
+        {
+            GLint done = GL_FALSE;
+            glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done)
+                return false;
+        }
+        finish();
+        return true;
+    }
+    // waits for the program, prints any compile or link errors, caches its binary and reflects its uniforms
+    // ------------------------------------------------------------------------
+    void finish()
+    {
+        if (!compiling)
+            return;
+        compiling = false;
+        bool compiled = true;
+        for (GLuint stage : stages)
+        {
+            GLint type = 0;
+            glGetShaderiv(stage, GL_SHADER_TYPE, &type);
+            compiled = checkCompileErrors(stage, type == GL_VERTEX_SHADER ? "VERTEX" : type == GL_FRAGMENT_SHADER ? "FRAGMENT" : "GEOMETRY") && compiled;
+        }
+        if (checkCompileErrors(ID, "PROGRAM") && compiled)
+            program_cache::store(ID, cacheKey);
+        countCompile(compileStart);
+        reflectUniforms();
         // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+        for (GLuint stage : stages)
+            glDeleteShader(stage);
+        stages.clear();
     }
-    // activate the shader
+    // activate the shader, waiting for it if it is still compiling
     // ------------------------------------------------------------------------
     void use()
     {
-        glUseProgram(ID);
+        finish();
+        GLState::instance().useProgram(ID);
+    }
+    // handle of an active uniform, invalid if the program has none by that name or isn't ready yet.
+    // array elements are found both as "name[i]" and, for the first, "name"
+    UniformHandle uniform(const std::string &name) const
+    {
+        UniformHandle handle;
+        auto it = uniforms.find(name);
+        if (it != uniforms.end())
+            handle.location = it->second;
+        return handle;
+    }
+    // index of an active uniform block, GL_INVALID_INDEX if there is none by that name
+    GLuint uniformBlock(const std::string &name) const
+    {
+        auto it = uniformBlocks.find(name);
+        return it != uniformBlocks.end() ? it->second : GL_INVALID_INDEX;
     }
-    // utility uniform functions
+    // utility uniform functions, by name these cost a hash lookup, by handle nothing
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        setBool(uniform(name), value);
+    }
+    void setBool(UniformHandle handle, bool value) const
+    {
+        glUniform1i(handle.location, (int)value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        setInt(uniform(name), value);
+    }
+    void setInt(UniformHandle handle, int value) const
+    {
+        glUniform1i(handle.location, value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        setFloat(uniform(name), value);
+    }
+    void setFloat(UniformHandle handle, float value) const
+    {
+        glUniform1f(handle.location, value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec2(uniform(name), value);
+    }
+    void setVec2(UniformHandle handle, const glm::vec2 &value) const
+    {
+        glUniform2fv(handle.location, 1, &value[0]);
     }
     void setVec2(const std::string &name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(uniform(name).location, x, y);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec3(uniform(name), value);
+    }
+    void setVec3(UniformHandle handle, const glm::vec3 &value) const
+    {
+        glUniform3fv(handle.location, 1, &value[0]);
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(uniform(name).location, x, y, z);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec4(uniform(name), value);
+    }
+    void setVec4(UniformHandle handle, const glm::vec4 &value) const
+    {
+        glUniform4fv(handle.location, 1, &value[0]);
     }
     void setVec4(const std::string &name, float x, float y, float z, float w)
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(uniform(name).location, x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(uniform(name), mat);
+    }
+    void setMat2(UniformHandle handle, const glm::mat2 &mat) const
+    {
+        glUniformMatrix2fv(handle.location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(uniform(name), mat);
+    }
+    void setMat3(UniformHandle handle, const glm::mat3 &mat) const
+    {
+        glUniformMatrix3fv(handle.location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(uniform(name), mat);
+    }
+    void setMat4(UniformHandle handle, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(handle.location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
 
 private:
-    // utility function for checking shader compilation/linking errors.
+    // shaders attached to the program while it compiles, deleted by finish()
+    std::vector<GLuint> stages;
+    bool compiling = false;
+    uint64_t cacheKey = 0;
+    std::chrono::steady_clock::time_point compileStart;
+    // active uniforms and uniform blocks of the linked program
+    std::unordered_map<std::string, GLint> uniforms;
+    std::unordered_map<std::string, GLuint> uniformBlocks;
+
+    // fills uniforms and uniformBlocks from the linked program, so nothing is queried by name while drawing
+    // ------------------------------------------------------------------------
+    void reflectUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> nameBuffer(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size = 0;
+            GLenum type;
+            GLsizei length = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+            std::string name(nameBuffer.data(), length);
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            // members of uniform blocks have no location, they are set through the block's buffer
+            if (location < 0)
+                continue;
+            uniforms[name] = location;
+            // arrays are reported as "name[0]", their elements each have a location of their own
+            size_t bracket = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0 ? name.size() - 3 : std::string::npos;
+            if (bracket == std::string::npos)
+                continue;
+            std::string base = name.substr(0, bracket);
+            uniforms[base] = location;
+            for (GLint element = 1; element < size; element++)
+            {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                uniforms[elementName] = glGetUniformLocation(ID, elementName.c_str());
+            }
+        }
+
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+        nameBuffer.resize(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, nameBuffer.data());
+            uniformBlocks[std::string(nameBuffer.data(), length)] = (GLuint)i;
+        }
+    }
+    // code with a #define line for each of defines after its #version line, which has to stay the first directive.
+    // a #line directive after them keeps the line numbers of compile errors those of the file
+    static std::string withDefines(const std::string &code, const std::vector<std::string> &defines)
+    {
+        if (defines.empty())
+            return code;
+        size_t insert = 0;
+        size_t version = code.find("#version");
+        if (version != std::string::npos)
+        {
+            size_t end = code.find('\n', version);
+            insert = end == std::string::npos ? code.size() : end + 1;
+        }
+        std::string lines = insert > 0 && code[insert - 1] != '\n' ? "\n" : "";
+        for (const std::string &define : defines)
+            lines += "#define " + define + "\n";
+        lines += "#line " + std::to_string(std::count(code.begin(), code.begin() + insert, '\n') + 1) + "\n";
+        return code.substr(0, insert) + lines + code.substr(insert);
+    }
+    // creates, submits and attaches one stage of the program
+    void compileStage(GLenum type, const std::string &code)
+    {
+        const char *source = code.c_str();
+        GLuint stage = glCreateShader(type);
+        glShaderSource(stage, 1, &source, NULL);
+        glCompileShader(stage);
+        glAttachShader(ID, stage);
+        stages.push_back(stage);
+    }
+    // whether the driver can report compile progress without blocking, GL_KHR_parallel_shader_compile
+    static bool parallelCompile()
+    {
+        static const bool supported = GLSL::hasExtension("GL_KHR_parallel_shader_compile") ||
+                                      GLSL::hasExtension("GL_ARB_parallel_shader_compile");
+        return supported;
+    }
+    // a program built from source, for the startup report
+    void countCompile(std::chrono::steady_clock::time_point start)
+    {
+        program_cache::stats().misses++;
+        program_cache::stats().compileMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    // utility function for checking shader compilation/linking errors, false if there were any.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -187,6 +430,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
 #endif
@@ -0,0 +1,100 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "Shader.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The permutations of one shader: its source files built with different sets of defines (see Shader), each a
+// program of its own. A variant is compiled the first time it is asked for and kept under its sorted defines,
+// so asking again is a lookup and the binary cache stores each variant apart. Like every Shader a new variant
+// compiles in the background, poll() finishes the ones that are done and runs setup on them once.
+class ShaderVariants
+{
+public:
+    // state each variant needs once it is linked (samplers, block bindings), run by poll() or finish()
+    std::function<void(Shader *)> setup;
+
+    ShaderVariants(const char *vertexPath, const char *fragmentPath) :
+        vertexPath(vertexPath), fragmentPath(fragmentPath) {}
+
+    // vertex shader only variants captured with transform feedback, see Shader
+    ShaderVariants(const char *vertexPath, const std::vector<std::string> &feedbackVaryings) :
+        vertexPath(vertexPath), feedbackVaryings(feedbackVaryings) {}
+
+    // the variant with defines, submitted for compiling if it is new. the order of defines doesn't matter.
+    // builds a key, so callers keep the pointer rather than asking every frame
+    Shader *get(const std::vector<std::string> &defines)
+    {
+        std::vector<std::string> sorted = defines;
+        std::sort(sorted.begin(), sorted.end());
+        std::string key;
+        for (const std::string &define : sorted) {
+            key += define + "\n";
+        }
+        auto it = variants.find(key);
+        if (it != variants.end()) {
+            return it->second.get();
+        }
+        Shader *shader = feedbackVaryings.empty() ? new Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, sorted)
+                                                  : new Shader(vertexPath.c_str(), feedbackVaryings, sorted);
+        variants[key].reset(shader);
+        pending.push_back(shader);
+        // restored from the binary cache, usable right away
+        if (shader->ready()) {
+            finished(pending.size() - 1);
+        }
+        return shader;
+    }
+
+    // finishes and sets up the variants that compiled since the last call without waiting on the rest.
+    // true once none is left compiling
+    bool poll()
+    {
+        for (size_t i = 0; i < pending.size();) {
+            if (pending[i]->poll()) {
+                finished(i);
+            }
+            else {
+                i++;
+            }
+        }
+        return pending.empty();
+    }
+
+    // waits for every variant asked for so far
+    void finish()
+    {
+        while (!pending.empty()) {
+            pending.back()->finish();
+            finished(pending.size() - 1);
+        }
+    }
+
+    size_t size() const
+    {
+        return variants.size();
+    }
+
+private:
+    std::string vertexPath, fragmentPath;
+    std::vector<std::string> feedbackVaryings;
+    std::unordered_map<std::string, std::unique_ptr<Shader>> variants;
+    // variants still compiling
+    std::vector<Shader *> pending;
+
+    void finished(size_t i)
+    {
+        Shader *shader = pending[i];
+        pending.erase(pending.begin() + i);
+        if (setup) {
+            setup(shader);
+        }
+    }
+};
+#endif
@@ -22,6 +22,7 @@
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <algorithm>
 
 #include "GLSL.h"
 #include "Shader.h"
@@ -62,19 +63,33 @@ Terrain::Terrain(const string &heightmap) {
         }
     }
 
-    //create faces
-    for (int r = 0; r < width-1; r++) {
-        for (int c = 0; c < height-1; c++) {
-            //face 1 of rectangle
-            eleBuf[6*(r*(height-1) + c) + 0] = (r*height+c);
-            eleBuf[6*(r*(height-1) + c) + 1] = (r*height+(c+1));
-            eleBuf[6*(r*(height-1) + c) + 2] = ((r+1)*height+(c+1));
-            //face 2 of rectangle
-            eleBuf[6*(r*(height-1) + c) + 3] = ((r+1)*height+(c+1));
-            eleBuf[6*(r*(height-1) + c) + 4] = ((r+1)*height+c);
-            eleBuf[6*(r*(height-1) + c) + 5] = (r*height+c);
+    //create faces, chunk by chunk so each chunk is a contiguous range that can be culled on its own
+    size_t face = 0;
+    auto positionOf = [this](unsigned int v) { return glm::vec3(posBuf[3*v + 0], posBuf[3*v + 1], posBuf[3*v + 2]); };
+    for (int r0 = 0; r0 < width-1; r0 += TERRAIN_CHUNK) {
+        for (int c0 = 0; c0 < height-1; c0 += TERRAIN_CHUNK) {
+            size_t chunkStart = face;
+            for (int r = r0; r < std::min(r0 + TERRAIN_CHUNK, width-1); r++) {
+                for (int c = c0; c < std::min(c0 + TERRAIN_CHUNK, height-1); c++) {
+                    //face 1 of rectangle
+                    eleBuf[face++] = (r*height+c);
+                    eleBuf[face++] = (r*height+(c+1));
+                    eleBuf[face++] = ((r+1)*height+(c+1));
+                    //face 2 of rectangle
+                    eleBuf[face++] = ((r+1)*height+(c+1));
+                    eleBuf[face++] = ((r+1)*height+c);
+                    eleBuf[face++] = (r*height+c);
+                }
+            }
+            chunks.push_back(meshlets::bounds(&eleBuf[chunkStart], face - chunkStart, positionOf));
+            chunks.back().firstIndex = (unsigned int)chunkStart;
         }
     }
+    chunkBounds.resize(chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        chunkBounds.set(i, chunks[i]);
+    }
+    chunkVisible.assign(chunkBounds.padded(), 1);
 
     init();
 }
@@ -83,49 +98,68 @@ float Terrain::getHeight(int x, int z) {
     return heightMap[x][z];
 }
 
-void Terrain::Draw(Shader* prog) const {
-    int h_pos = -1, h_nor = -1;
-    
-    prog->setMat4("model", model);
-
-    CHECKED_GL_CALL(glBindVertexArray(vaoID));
-    h_pos = glGetAttribLocation(prog->ID, "vertPos");
-    h_nor = glGetAttribLocation(prog->ID, "vertNor");
-    
-    // Bind position buffer
-    GLSL::enableVertexAttribArray(h_pos);
-    CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, posBufID));
-    CHECKED_GL_CALL(glVertexAttribPointer(h_pos, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0));
-
-    // Bind normal buffer
-    GLSL::enableVertexAttribArray(h_nor);
-    CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, norBufID));
-    CHECKED_GL_CALL(glVertexAttribPointer(h_nor, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0));
-
-
-    // Bind element buffer
-    CHECKED_GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID));
-
-    // Draw
-    CHECKED_GL_CALL(glDrawElements(GL_TRIANGLES, (int)eleBuf.size(), GL_UNSIGNED_INT, (const void *)0));
+void Terrain::Draw(Shader* prog, const glm::mat4 &projection, const glm::mat4 &view) {
+    if (prog->ID != modelProgram) {
+        modelProgram = prog->ID;
+        modelUniform = prog->uniform("model");
+    }
+    prog->setMat4(modelUniform, model);
+
+    // cull the chunks in model space, runs of visible chunks become one range
+    glm::mat4 modelView = view * model;
+    glm::vec4 planes[6];
+    meshlets::frustumPlanes(projection * modelView, planes);
+    meshlets::cull(chunkBounds, planes, glm::vec3(glm::inverse(modelView)[3]), chunkVisible.data());
+    drawCounts.clear();
+    drawOffsets.clear();
+    GLuint rangeEnd = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (!chunkVisible[i]) {
+            continue;
+        }
+        if (!drawCounts.empty() && rangeEnd == chunks[i].firstIndex) {
+            drawCounts.back() += chunks[i].indexCount;
+        }
+        else {
+            drawCounts.push_back(chunks[i].indexCount);
+            drawOffsets.push_back((const void *)(chunks[i].firstIndex * sizeof(unsigned int)));
+        }
+        rangeEnd = chunks[i].firstIndex + chunks[i].indexCount;
+    }
+    if (drawCounts.empty()) {
+        return;
+    }
 
-    GLSL::disableVertexAttribArray(h_nor);
-    GLSL::disableVertexAttribArray(h_pos);
-    CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
-    CHECKED_GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+    // the VAO holds the attributes and element buffer, set up once by init()
+    GLState::instance().bindVertexArray(vaoID);
+    CHECKED_GL_CALL(glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), GL_UNSIGNED_INT, drawOffsets.data(), (GLsizei)drawCounts.size()));
 }
 
 
 void Terrain::init() {
+    // uploading again replaces the buffers, unbound first as a new VAO may get the old one's name
+    if (vaoID) {
+        GLState::instance().bindVertexArray(0);
+        CHECKED_GL_CALL(glDeleteVertexArrays(1, &vaoID));
+        GLuint buffers[] = {posBufID, norBufID, eleBufID};
+        CHECKED_GL_CALL(glDeleteBuffers(3, buffers));
+    }
     CHECKED_GL_CALL(glGenVertexArrays(1, &vaoID));
-    CHECKED_GL_CALL(glBindVertexArray(vaoID));
-    cout << "Terrain VAOID: " << vaoID << endl;
+    GLState::instance().bindVertexArray(vaoID);
+    if (initReport) {
+        cout << "Terrain VAOID: " << vaoID << endl;
+    }
 
     // Send the position array to the GPU
     CHECKED_GL_CALL(glGenBuffers(1, &posBufID));
     CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, posBufID));
     CHECKED_GL_CALL(glBufferData(GL_ARRAY_BUFFER, posBuf.size()*sizeof(float), &posBuf[0], GL_STATIC_DRAW));
-    cout << "Terrain posBufID: " << posBufID << endl;
+    if (initReport) {
+        cout << "Terrain posBufID: " << posBufID << endl;
+    }
+    // vertPos in terrain.vert
+    GLSL::enableVertexAttribArray(0);
+    CHECKED_GL_CALL(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0));
     
     // Send the normal array to the GPU
     if (norBuf.empty())
@@ -167,15 +201,22 @@ void Terrain::init() {
     CHECKED_GL_CALL(glGenBuffers(1, &norBufID));
     CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, norBufID));
     CHECKED_GL_CALL(glBufferData(GL_ARRAY_BUFFER, norBuf.size()*sizeof(float), &norBuf[0], GL_STATIC_DRAW));
-    cout << "Terrain norBufID: " << norBufID << endl;
+    if (initReport) {
+        cout << "Terrain norBufID: " << norBufID << endl;
+    }
+    // vertNor
+    GLSL::enableVertexAttribArray(1);
+    CHECKED_GL_CALL(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0));
     
     // Send the element array to the GPU
     CHECKED_GL_CALL(glGenBuffers(1, &eleBufID));
     CHECKED_GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID));
     CHECKED_GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, eleBuf.size()*sizeof(unsigned int), &eleBuf[0], GL_STATIC_DRAW));
-    cout << "Terrain eleBufID: " << eleBufID << endl;
+    if (initReport) {
+        cout << "Terrain eleBufID: " << eleBufID << endl;
+    }
 
-    // Unbind the arrays
+    // Unbind the arrays, the element buffer stays bound in the VAO
+    GLState::instance().bindVertexArray(0);
     CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
-    CHECKED_GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
 }
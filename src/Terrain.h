@@ -9,6 +9,11 @@
 #ifndef Terrain_h
 #define Terrain_h
 
+#include "Meshlets.h"
+
+// quads along each side of a terrain chunk, 8 makes 128 triangles per chunk
+const int TERRAIN_CHUNK = 8;
+
 struct TerrainVertex {
     glm::vec3 position;
     glm::vec3 color;
@@ -18,8 +23,12 @@ struct TerrainVertex {
 class Terrain {
 public:
     Terrain(std::string const &path);
-    void Draw(Shader* shader) const;
+    // draws the chunks of the grid inside the view frustum that face the camera
+    void Draw(Shader* shader, const glm::mat4 &projection, const glm::mat4 &view);
+    // uploads the grid, again on later calls
     void init();
+    // init() prints the names of the buffers it creates, benchmarks turn it off
+    bool initReport = true;
     float getHeight(int x, int z);
 private:
     std::vector<unsigned int> eleBuf;
@@ -32,6 +41,16 @@ private:
     unsigned int norBufID = 0;
     unsigned int vaoID = 0;
     std::vector<TerrainVertex> vertices;
+    // eleBuf is laid out chunk by chunk, each chunk a cluster with model space bounds
+    std::vector<meshlets::Meshlet> chunks;
+    meshlets::Bounds chunkBounds;
+    std::vector<unsigned char> chunkVisible;
+    // the visible chunks of the last Draw as glMultiDrawElements ranges
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void *> drawOffsets;
+    // the model uniform of the program Draw last used
+    unsigned int modelProgram = 0;
+    UniformHandle modelUniform;
 };
 
 #endif /* Terrain_h */
@@ -0,0 +1,319 @@
+#ifndef TEXTURE_BAKER_H
+#define TEXTURE_BAKER_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "stb_image.h"
+#include "Ktx2.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Offline texture baking: builds the mip chain on the CPU and block compresses every level into a
+// KTX2 file the TextureLoader uploads as is. Colour maps become BC1 (BC3 if they use alpha), normal
+// maps become BC5 holding x and y only, the shader rebuilds z.
+namespace texture_baker {
+
+    // colour maps (diffuse, emissive) are sRGB encoded and filtered in linear space, data maps (metallic/roughness,
+    // specular, height) already hold linear values and are filtered as stored
+    enum Texture_Kind {
+        TEXTURE_COLOR,
+        TEXTURE_NORMAL,
+        TEXTURE_DATA
+    };
+
+    // the kind of a model texture from its sampler type (texture_diffuse, texture_pbr...)
+    inline Texture_Kind kindOf(std::string const &type) {
+        if (type == "texture_normal") {
+            return TEXTURE_NORMAL;
+        }
+        if (type == "texture_diffuse" || type == "texture_emissive") {
+            return TEXTURE_COLOR;
+        }
+        return TEXTURE_DATA;
+    }
+
+    // one mip level as floats: linear colour or data, or a unit vector for normal maps
+    struct Image {
+        int width = 0;
+        int height = 0;
+        std::vector<glm::vec4> pixels;
+
+        const glm::vec4 &at(int x, int y) const {
+            // textures repeat, so filters wrap around the edges
+            x = ((x % width) + width) % width;
+            y = ((y % height) + height) % height;
+            return pixels[(size_t)y * width + x];
+        }
+    };
+
+    inline float srgbToLinear(float c) {
+        return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    inline float linearToSrgb(float c) {
+        return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+    }
+
+    inline unsigned char toByte(float c) {
+        return (unsigned char)glm::clamp((int)(c * 255.0f + 0.5f), 0, 255);
+    }
+
+    // halves the image with a separable [1 3 3 1] filter, which aliases much less than a 2x2 box
+    inline Image downsample(const Image &src, Texture_Kind kind) {
+        const float weights[4] = {1.0f / 8.0f, 3.0f / 8.0f, 3.0f / 8.0f, 1.0f / 8.0f};
+        Image dst;
+        dst.width = std::max(1, src.width / 2);
+        dst.height = std::max(1, src.height / 2);
+        dst.pixels.resize((size_t)dst.width * dst.height);
+        for (int y = 0; y < dst.height; y++) {
+            for (int x = 0; x < dst.width; x++) {
+                glm::vec4 sum(0.0f);
+                for (int j = 0; j < 4; j++) {
+                    for (int i = 0; i < 4; i++) {
+                        // a 1 pixel wide or tall source only filters along the other axis
+                        int sx = src.width > 1 ? 2 * x - 1 + i : 0;
+                        int sy = src.height > 1 ? 2 * y - 1 + j : 0;
+                        sum += src.at(sx, sy) * weights[i] * weights[j];
+                    }
+                }
+                if (kind == TEXTURE_NORMAL) {
+                    glm::vec3 n = glm::vec3(sum);
+                    float length = glm::length(n);
+                    sum = glm::vec4(length > 1e-6f ? n / length : glm::vec3(0.0f, 0.0f, 1.0f), 1.0f);
+                }
+                dst.pixels[(size_t)y * dst.width + x] = sum;
+            }
+        }
+        return dst;
+    }
+
+    // back to the 8 bit encoding of the source file
+    inline std::vector<glm::u8vec4> toBytes(const Image &image, Texture_Kind kind) {
+        std::vector<glm::u8vec4> bytes(image.pixels.size());
+        for (size_t i = 0; i < image.pixels.size(); i++) {
+            const glm::vec4 &p = image.pixels[i];
+            if (kind == TEXTURE_NORMAL) {
+                bytes[i] = glm::u8vec4(toByte(p.x * 0.5f + 0.5f), toByte(p.y * 0.5f + 0.5f), toByte(p.z * 0.5f + 0.5f), 255);
+            }
+            else if (kind == TEXTURE_COLOR) {
+                bytes[i] = glm::u8vec4(toByte(linearToSrgb(p.x)), toByte(linearToSrgb(p.y)), toByte(linearToSrgb(p.z)), toByte(p.w));
+            }
+            else {
+                bytes[i] = glm::u8vec4(toByte(p.x), toByte(p.y), toByte(p.z), toByte(p.w));
+            }
+        }
+        return bytes;
+    }
+
+    inline uint16_t to565(glm::vec3 c) {
+        int r = glm::clamp((int)(c.r * 31.0f / 255.0f + 0.5f), 0, 31);
+        int g = glm::clamp((int)(c.g * 63.0f / 255.0f + 0.5f), 0, 63);
+        int b = glm::clamp((int)(c.b * 31.0f / 255.0f + 0.5f), 0, 31);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    inline glm::vec3 from565(uint16_t c) {
+        int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+        return glm::vec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+    }
+
+    // BC1 colour block: endpoints on the principal axis of the block's colours, 4 colour mode
+    inline void encodeColorBlock(const glm::u8vec4 block[16], unsigned char *out) {
+        glm::vec3 mean(0.0f);
+        for (int i = 0; i < 16; i++) {
+            mean += glm::vec3(block[i]);
+        }
+        mean /= 16.0f;
+        glm::mat3 covariance(0.0f);
+        for (int i = 0; i < 16; i++) {
+            glm::vec3 d = glm::vec3(block[i]) - mean;
+            covariance += glm::outerProduct(d, d);
+        }
+        // power iteration for the dominant eigenvector
+        glm::vec3 axis(1.0f, 1.0f, 1.0f);
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 next = covariance * axis;
+            float length = glm::length(next);
+            if (length < 1e-6f) {
+                break;
+            }
+            axis = next / length;
+        }
+        float minProj = 1e30f, maxProj = -1e30f;
+        for (int i = 0; i < 16; i++) {
+            float p = glm::dot(glm::vec3(block[i]) - mean, axis);
+            minProj = std::min(minProj, p);
+            maxProj = std::max(maxProj, p);
+        }
+        uint16_t c0 = to565(mean + axis * maxProj);
+        uint16_t c1 = to565(mean + axis * minProj);
+        if (c0 < c1) {
+            std::swap(c0, c1);
+        }
+
+        uint32_t indices = 0;
+        if (c0 != c1) {
+            glm::vec3 palette[4];
+            palette[0] = from565(c0);
+            palette[1] = from565(c1);
+            palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+            palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+            for (int i = 0; i < 16; i++) {
+                glm::vec3 c(block[i]);
+                int best = 0;
+                float bestError = 1e30f;
+                for (int p = 0; p < 4; p++) {
+                    glm::vec3 d = c - palette[p];
+                    float error = glm::dot(d, d);
+                    if (error < bestError) {
+                        bestError = error;
+                        best = p;
+                    }
+                }
+                indices |= (uint32_t)best << (2 * i);
+            }
+        }
+        memcpy(out, &c0, 2);
+        memcpy(out + 2, &c1, 2);
+        memcpy(out + 4, &indices, 4);
+    }
+
+    // BC4 single channel block, 8 value mode between the block's min and max
+    inline void encodeChannelBlock(const unsigned char values[16], unsigned char *out) {
+        unsigned char a0 = 0, a1 = 255;
+        for (int i = 0; i < 16; i++) {
+            a0 = std::max(a0, values[i]);
+            a1 = std::min(a1, values[i]);
+        }
+        uint64_t indices = 0;
+        if (a0 != a1) {
+            float palette[8];
+            palette[0] = a0;
+            palette[1] = a1;
+            for (int p = 1; p < 7; p++) {
+                palette[p + 1] = ((7 - p) * a0 + p * a1) / 7.0f;
+            }
+            for (int i = 0; i < 16; i++) {
+                int best = 0;
+                float bestError = 1e30f;
+                for (int p = 0; p < 8; p++) {
+                    float error = fabsf(values[i] - palette[p]);
+                    if (error < bestError) {
+                        bestError = error;
+                        best = p;
+                    }
+                }
+                indices |= (uint64_t)best << (3 * i);
+            }
+        }
+        out[0] = a0;
+        out[1] = a1;
+        for (int b = 0; b < 6; b++) {
+            out[2 + b] = (unsigned char)(indices >> (8 * b));
+        }
+    }
+
+    // block compresses one level, blocks past the edge of small levels repeat the last texel
+    inline std::vector<unsigned char> compress(const std::vector<glm::u8vec4> &pixels, int width, int height, uint32_t vkFormat) {
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        uint32_t blockBytes = ktx2::blockBytes(vkFormat);
+        std::vector<unsigned char> data((size_t)blocksX * blocksY * blockBytes);
+        for (int by = 0; by < blocksY; by++) {
+            for (int bx = 0; bx < blocksX; bx++) {
+                glm::u8vec4 block[16];
+                for (int i = 0; i < 16; i++) {
+                    int x = std::min(bx * 4 + i % 4, width - 1);
+                    int y = std::min(by * 4 + i / 4, height - 1);
+                    block[i] = pixels[(size_t)y * width + x];
+                }
+                unsigned char *out = &data[((size_t)by * blocksX + bx) * blockBytes];
+                unsigned char channel[16];
+                if (vkFormat == ktx2::VK_FORMAT_BC1_RGB_UNORM_BLOCK) {
+                    encodeColorBlock(block, out);
+                }
+                else if (vkFormat == ktx2::VK_FORMAT_BC3_UNORM_BLOCK) {
+                    for (int i = 0; i < 16; i++) channel[i] = block[i].a;
+                    encodeChannelBlock(channel, out);
+                    encodeColorBlock(block, out + 8);
+                }
+                else {
+                    for (int i = 0; i < 16; i++) channel[i] = block[i].r;
+                    encodeChannelBlock(channel, out);
+                    for (int i = 0; i < 16; i++) channel[i] = block[i].g;
+                    encodeChannelBlock(channel, out + 8);
+                }
+            }
+        }
+        return data;
+    }
+
+    // bakes the image at inPath into a KTX2 file at outPath, see ktx2::bakedPath for where the runtime looks
+    inline bool bake(std::string const &inPath, std::string const &outPath, Texture_Kind kind) {
+        int width, height, components;
+        unsigned char *data = stbi_load(inPath.c_str(), &width, &height, &components, 4);
+        if (!data) {
+            std::cout << "ERROR::TEXTURE_BAKER:: could not load " << inPath << std::endl;
+            return false;
+        }
+
+        Image level;
+        level.width = width;
+        level.height = height;
+        level.pixels.resize((size_t)width * height);
+        bool hasAlpha = false;
+        for (size_t i = 0; i < level.pixels.size(); i++) {
+            const unsigned char *p = data + 4 * i;
+            if (kind == TEXTURE_NORMAL) {
+                level.pixels[i] = glm::vec4(glm::vec3(p[0], p[1], p[2]) / 127.5f - 1.0f, 1.0f);
+            }
+            else if (kind == TEXTURE_COLOR) {
+                // filter colour in linear space so mips don't darken
+                level.pixels[i] = glm::vec4(srgbToLinear(p[0] / 255.0f), srgbToLinear(p[1] / 255.0f), srgbToLinear(p[2] / 255.0f), p[3] / 255.0f);
+                hasAlpha = hasAlpha || p[3] < 255;
+            }
+            else {
+                level.pixels[i] = glm::vec4(p[0], p[1], p[2], p[3]) / 255.0f;
+                hasAlpha = hasAlpha || p[3] < 255;
+            }
+        }
+        stbi_image_free(data);
+
+        uint32_t vkFormat = ktx2::VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+        if (kind == TEXTURE_NORMAL) {
+            vkFormat = ktx2::VK_FORMAT_BC5_UNORM_BLOCK;
+        }
+        else if (hasAlpha) {
+            vkFormat = ktx2::VK_FORMAT_BC3_UNORM_BLOCK;
+        }
+
+        std::vector<std::vector<unsigned char>> levels;
+        size_t uncompressed = 0;
+        for (;;) {
+            levels.push_back(compress(toBytes(level, kind), level.width, level.height, vkFormat));
+            uncompressed += level.pixels.size() * 4;
+            if (level.width == 1 && level.height == 1) {
+                break;
+            }
+            level = downsample(level, kind);
+        }
+
+        if (!ktx2::write(outPath, vkFormat, width, height, levels)) {
+            return false;
+        }
+        size_t compressed = 0;
+        for (size_t i = 0; i < levels.size(); i++) {
+            compressed += levels[i].size();
+        }
+        std::cout << "baked " << inPath << " -> " << outPath << ": " << width << "x" << height << ", " << levels.size()
+                  << " levels, " << compressed / 1024 << " KB (" << uncompressed / 1024 << " KB as RGBA8)" << std::endl;
+        return true;
+    }
+}
+#endif
@@ -0,0 +1,188 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "TextureLoader.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <limits.h>
+#endif
+
+// Process wide registry of loaded textures, so models sharing an image decode and upload it once.
+// Entries are keyed by the canonical path and the sampler settings and counted by reference. Textures nobody references stay resident for reuse until the cache grows past its
+// budget, then the least recently released are deleted first.
+class TextureCache
+{
+public:
+    static TextureCache &instance()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // returns the texture for path, loading it (see TextureLoader::load) if it isn't cached
+    unsigned int acquire(std::string const &path, glm::u8vec4 placeholder = glm::u8vec4(255), SamplerSettings sampler = SamplerSettings())
+    {
+        std::string canonical = canonicalPath(path);
+        std::string key = entryKey(canonical, sampler);
+        std::unordered_map<std::string, Entry>::iterator it = entries.find(key);
+        if (it != entries.end()) {
+            it->second.refCount++;
+            hits++;
+            return it->second.textureID;
+        }
+
+        Entry entry;
+        entry.textureID = TextureLoader::instance().load(canonical, placeholder, sampler);
+        entry.refCount = 1;
+        entries[key] = entry;
+        keysByTexture[entry.textureID] = key;
+        misses++;
+        evict();
+        return entry.textureID;
+    }
+
+    // drops a reference taken by acquire
+    void release(unsigned int textureID)
+    {
+        std::unordered_map<unsigned int, std::string>::iterator key = keysByTexture.find(textureID);
+        if (key == keysByTexture.end()) {
+            std::cout << "ERROR::TEXTURE_CACHE:: releasing texture " << textureID << " which isn't cached" << std::endl;
+            return;
+        }
+        Entry &entry = entries[key->second];
+        if (entry.refCount > 0 && --entry.refCount == 0) {
+            entry.lastRelease = ++releaseCounter;
+        }
+        evict();
+    }
+
+    // GPU memory unreferenced textures may keep occupied, referenced ones are never evicted
+    void setBudget(size_t bytes)
+    {
+        budget = bytes;
+        evict();
+    }
+
+    size_t residentBytes() const
+    {
+        size_t total = 0;
+        for (std::unordered_map<std::string, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+            total += TextureLoader::instance().textureBytes(it->second.textureID);
+        }
+        return total;
+    }
+
+    void report() const
+    {
+        std::cout << "texture cache: " << entries.size() << " textures, " << residentBytes() / (1024 * 1024) << " MB resident, "
+                  << hits << " hits, " << misses << " misses, " << evictions << " evicted" << std::endl;
+    }
+
+    TextureCache(const TextureCache &) = delete;
+    TextureCache &operator=(const TextureCache &) = delete;
+
+private:
+    struct Entry {
+        unsigned int textureID = 0;
+        int refCount = 0;
+        uint64_t lastRelease = 0;
+    };
+
+    std::unordered_map<std::string, Entry> entries;
+    std::unordered_map<unsigned int, std::string> keysByTexture;
+    size_t budget = 256 * 1024 * 1024;
+    uint64_t releaseCounter = 0;
+    int hits = 0, misses = 0, evictions = 0;
+
+    TextureCache() {}
+
+    // deletes unreferenced textures, oldest release first, until the cache fits its budget
+    void evict()
+    {
+        size_t total = residentBytes();
+        while (total > budget) {
+            std::unordered_map<std::string, Entry>::iterator victim = entries.end();
+            for (std::unordered_map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                // textures still streaming in count as 0 bytes and can't be deleted under the loader
+                if (it->second.refCount == 0 && TextureLoader::instance().textureBytes(it->second.textureID) > 0 &&
+                    (victim == entries.end() || it->second.lastRelease < victim->second.lastRelease)) {
+                    victim = it;
+                }
+            }
+            if (victim == entries.end()) {
+                return;
+            }
+            total -= TextureLoader::instance().textureBytes(victim->second.textureID);
+            TextureLoader::instance().destroy(victim->second.textureID);
+            keysByTexture.erase(victim->second.textureID);
+            entries.erase(victim);
+            evictions++;
+        }
+    }
+
+    // the path followed by the sampler settings, a path can't contain the separating NUL
+    static std::string entryKey(std::string const &path, const SamplerSettings &sampler)
+    {
+        std::string key = path;
+        const GLenum settings[4] = {sampler.wrapS, sampler.wrapT, sampler.minFilter, sampler.magFilter};
+        for (int i = 0; i < 4; i++) {
+            key += '\0';
+            key += std::to_string(settings[i]);
+        }
+        return key;
+    }
+
+    // resolves the path through the file system so different spellings of one file share an entry,
+    // falling back to tidying it up lexically if the file can't be found
+    static std::string canonicalPath(std::string const &path)
+    {
+#ifdef _WIN32
+        char resolved[_MAX_PATH];
+        if (_fullpath(resolved, path.c_str(), _MAX_PATH)) {
+            std::string result = resolved;
+            for (size_t i = 0; i < result.size(); i++) {
+                if (result[i] == '\\') result[i] = '/';
+            }
+            return result;
+        }
+#else
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved)) {
+            return resolved;
+        }
+#endif
+        std::vector<std::string> parts;
+        std::string part;
+        bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+        for (size_t i = 0; i <= path.size(); i++) {
+            if (i == path.size() || path[i] == '/' || path[i] == '\\') {
+                if (part == "..") {
+                    if (!parts.empty() && parts.back() != "..") parts.pop_back();
+                    else if (!absolute) parts.push_back(part);
+                }
+                else if (!part.empty() && part != ".") {
+                    parts.push_back(part);
+                }
+                part.clear();
+            }
+            else {
+                part += path[i];
+            }
+        }
+        std::string result = absolute ? "/" : "";
+        for (size_t i = 0; i < parts.size(); i++) {
+            result += (i > 0 ? "/" : "") + parts[i];
+        }
+        return result;
+    }
+};
+#endif
@@ -0,0 +1,351 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "stb_image.h"
+#include "Ktx2.h"
+#include "GLSL.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// S3TC is an extension glad wasn't generated with, RGTC is core
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// how a texture is sampled, applied by the loader and part of the texture cache's key
+struct SamplerSettings {
+    GLenum wrapS = GL_REPEAT;
+    GLenum wrapT = GL_REPEAT;
+    GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    GLenum magFilter = GL_LINEAR;
+};
+
+// Loads textures without blocking the render thread. load() hands back a texture name at once,
+// holding a 1x1 placeholder; the image is decoded by a pool of worker threads and pump(), called
+// once per frame, copies decoded pixels into a pixel buffer object a budgeted number of bytes at a
+// time. When a texture's pixels are all staged it is specified from the PBO, so the transfer itself
+// runs asynchronously in the driver, and the placeholder is replaced.
+// If an image has been baked (see TextureBaker.h) its .ktx2 file is read instead and the
+// precompressed mips are uploaded as they are, without glGenerateMipmap.
+class TextureLoader
+{
+public:
+    // the loader used by every model
+    static TextureLoader &instance()
+    {
+        static TextureLoader loader;
+        return loader;
+    }
+
+    // creates the texture, shows placeholder (RGBA) in it and queues path for decoding
+    unsigned int load(std::string const &path, glm::u8vec4 placeholder = glm::u8vec4(255), SamplerSettings sampler = SamplerSettings())
+    {
+        GLuint textureID;
+        glGenTextures(1, &textureID);
+        GLState::instance().bindTexture(UPLOAD_UNIT, textureID);
+        GLState::instance().activeTexture(UPLOAD_UNIT);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &placeholder[0]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
+        // the placeholder has no mips
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.magFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+
+        if (compressedSupport < 0) {
+            compressedSupport = GLSL::hasExtension("GL_EXT_texture_compression_s3tc") ? 1 : 0;
+        }
+
+        Job job;
+        job.textureID = textureID;
+        job.path = path;
+        job.allowCompressed = compressedSupport == 1;
+        job.minFilter = sampler.minFilter;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+            outstanding++;
+        }
+        jobReady.notify_one();
+        return textureID;
+    }
+
+    // stages and uploads decoded textures, copying at most byteBudget bytes this frame.
+    // a texture bigger than the budget is spread over several frames
+    void pump(size_t byteBudget)
+    {
+        size_t spent = 0;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        while (spent < byteBudget) {
+            if (!hasStaging) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (decoded.empty()) {
+                    break;
+                }
+                staging = std::move(decoded.front());
+                decoded.pop_front();
+                hasStaging = true;
+            }
+            if (staging.size == 0) {
+                // failed to decode, the placeholder stays
+                finishStaging();
+                continue;
+            }
+            if (staging.copied == 0) {
+                glGenBuffers(1, &staging.pbo);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.pbo);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, staging.size, NULL, GL_STREAM_DRAW);
+            }
+            else {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.pbo);
+            }
+
+            size_t chunk = std::min(staging.size - staging.copied, byteBudget - spent);
+            void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, staging.copied, chunk,
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            bool written = false;
+            if (dst) {
+                memcpy(dst, staging.pixels + staging.copied, chunk);
+                written = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+            }
+            if (!written) {
+                // the map failed or lost its contents, the driver copies the chunk instead
+                glBufferSubData(GL_PIXEL_UNPACK_BUFFER, staging.copied, chunk, staging.pixels + staging.copied);
+            }
+            staging.copied += chunk;
+            spent += chunk;
+
+            if (staging.copied == staging.size) {
+                // everything is staged, specify the texture from the PBO
+                GLState::instance().bindTexture(UPLOAD_UNIT, staging.textureID);
+                GLState::instance().activeTexture(UPLOAD_UNIT);
+                if (staging.compressed) {
+                    GLenum format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+                    if (staging.image.vkFormat == ktx2::VK_FORMAT_BC3_UNORM_BLOCK)
+                        format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+                    else if (staging.image.vkFormat == ktx2::VK_FORMAT_BC5_UNORM_BLOCK)
+                        format = GL_COMPRESSED_RG_RGTC2;
+                    for (size_t i = 0; i < staging.image.levels.size(); i++) {
+                        const ktx2::Level &level = staging.image.levels[i];
+                        size_t offset = level.data - staging.pixels;
+                        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, format, level.width, level.height, 0, (GLsizei)level.size, (void*)offset);
+                    }
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)staging.image.levels.size() - 1);
+                    residentBytes[staging.textureID] = staging.size;
+                }
+                else {
+                    GLenum format = GL_RGBA;
+                    if (staging.components == 1)
+                        format = GL_RED;
+                    else if (staging.components == 3)
+                        format = GL_RGB;
+                    glTexImage2D(GL_TEXTURE_2D, 0, format, staging.width, staging.height, 0, format, GL_UNSIGNED_BYTE, (void*)0);
+                    glGenerateMipmap(GL_TEXTURE_2D);
+                    // drivers pad rows to 4 bytes, and the mip chain adds a third
+                    residentBytes[staging.textureID] = (size_t)staging.width * staging.height * 4 * 4 / 3;
+                }
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, staging.minFilter);
+                // the driver keeps the buffer alive until the transfer is done
+                glDeleteBuffers(1, &staging.pbo);
+                finishStaging();
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        bytesUploaded += spent;
+    }
+
+    // true once every texture requested so far has been uploaded
+    bool idle()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return outstanding == 0;
+    }
+
+    // pumps without a budget until every queued texture is uploaded, for tools that need the final images
+    void finish()
+    {
+        while (!idle()) {
+            pump(SIZE_MAX);
+            std::this_thread::yield();
+        }
+    }
+
+    size_t uploadedBytes() const { return bytesUploaded; }
+
+    // approximate GPU memory of a texture, 0 while it still shows its placeholder
+    size_t textureBytes(unsigned int textureID) const
+    {
+        std::unordered_map<GLuint, size_t>::const_iterator it = residentBytes.find(textureID);
+        return it != residentBytes.end() ? it->second : 0;
+    }
+
+    // deletes a texture whose upload has finished
+    void destroy(unsigned int textureID)
+    {
+        residentBytes.erase(textureID);
+        GLState::instance().forgetTexture(textureID);
+        glDeleteTextures(1, &textureID);
+    }
+
+    ~TextureLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+        // GL objects are left to the context, which is gone by the time statics are destroyed
+        for (size_t i = 0; i < decoded.size(); i++) {
+            decoded[i].release();
+        }
+        staging.release();
+    }
+
+    TextureLoader(const TextureLoader &) = delete;
+    TextureLoader &operator=(const TextureLoader &) = delete;
+
+private:
+    // textures are bound to this unit while they are specified, above the ones draws use so their bindings stay
+    static const GLuint UPLOAD_UNIT = 15;
+
+    struct Job {
+        GLuint textureID;
+        std::string path;
+        bool allowCompressed;
+        GLenum minFilter;
+    };
+
+    struct Decoded {
+        GLuint textureID = 0;
+        GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+        int width = 0, height = 0, components = 0;
+        // bytes to stage, stb_image's pixels or the whole KTX2 file; size 0 if loading failed
+        unsigned char *pixels = nullptr;
+        size_t size = 0;
+        bool compressed = false;
+        std::vector<unsigned char> file;
+        ktx2::Image image;
+        // staging progress, only touched by the render thread
+        GLuint pbo = 0;
+        size_t copied = 0;
+
+        void release() {
+            if (!compressed && pixels) {
+                stbi_image_free(pixels);
+            }
+            pixels = nullptr;
+            file.clear();
+        }
+    };
+
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    std::deque<Job> jobs;
+    std::deque<Decoded> decoded;
+    std::vector<std::thread> workers;
+    Decoded staging;
+    bool hasStaging = false;
+    // -1 until the first load() asks the context
+    int compressedSupport = -1;
+    int outstanding = 0;
+    bool stopping = false;
+    size_t bytesUploaded = 0;
+    // render thread only
+    std::unordered_map<GLuint, size_t> residentBytes;
+
+    TextureLoader()
+    {
+        // leave a core for the render thread
+        unsigned int count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int i = 0; i < count; i++) {
+            workers.push_back(std::thread(&TextureLoader::work, this));
+        }
+    }
+
+    void work()
+    {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping) {
+                    return;
+                }
+                job = jobs.front();
+                jobs.pop_front();
+            }
+
+            Decoded result;
+            result.textureID = job.textureID;
+            result.minFilter = job.minFilter;
+            if (!(job.allowCompressed && readBaked(ktx2::bakedPath(job.path), result))) {
+                result.pixels = stbi_load(job.path.c_str(), &result.width, &result.height, &result.components, 0);
+                if (result.pixels) {
+                    result.size = (size_t)result.width * result.height * result.components;
+                }
+                else {
+                    std::cout << "Texture failed to load at path: " << job.path << std::endl;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(std::move(result));
+        }
+    }
+
+    // reads a baked texture into result, false if there is none or it can't be used
+    bool readBaked(std::string const &path, Decoded &result)
+    {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) {
+            return false;
+        }
+        result.file.resize((size_t)in.tellg());
+        in.seekg(0);
+        in.read((char *)result.file.data(), result.file.size());
+        if (!in || !ktx2::parse(result.file.data(), result.file.size(), result.image)) {
+            std::cout << "ERROR::TEXTURE_LOADER:: ignoring unreadable baked texture " << path << std::endl;
+            result.file.clear();
+            return false;
+        }
+        result.compressed = true;
+        result.pixels = result.file.data();
+        result.size = result.file.size();
+        return true;
+    }
+
+    void finishStaging()
+    {
+        staging.release();
+        staging = Decoded();
+        hasStaging = false;
+        std::lock_guard<std::mutex> lock(mutex);
+        outstanding--;
+    }
+};
+#endif
@@ -0,0 +1,179 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+const int MAX_BONES_VERTEX = 4;
+// max bones that can be read - must match vertex shader
+const int MAX_BONES = 110;
+
+//TODO add skinned mesh data to vertices (bone weights)
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+    // weights of bones affecting this vertex
+    float boneWeights[MAX_BONES_VERTEX] = {0};
+    // id's of said bones, needed to index into the transformations array in vert shader
+    int boneIds[MAX_BONES_VERTEX] = {0};
+    //num bones affecting this vertex
+    unsigned int numBones = 0;
+};
+
+// layout of the vertex buffer uploaded for a mesh, chosen when the model is loaded
+enum Vertex_Format {
+    VERTEX_FULL,    // Vertex as is, 92 bytes
+    VERTEX_PACKED   // PackedVertex, 32 bytes, decoded in animate.vert
+};
+
+// compressed skinned vertex. normals and tangents are octahedral encoded, the bitangent is
+// rebuilt in the shader from cross(normal, tangent) and the sign kept in the tangent's w
+struct PackedVertex {
+    glm::vec3 Position;
+    // octahedral normal, snorm16 x2
+    int16_t Normal[2];
+    // octahedral tangent as 2_10_10_10_REV snorm, x and y used, w is the bitangent sign
+    uint32_t Tangent;
+    // half floats
+    uint16_t TexCoords[2];
+    // bone ids fit in a byte since MAX_BONES <= 256
+    uint8_t boneIds[MAX_BONES_VERTEX];
+    // unorm8 weights, rounded so they still sum to the original total
+    uint8_t boneWeights[MAX_BONES_VERTEX];
+};
+static_assert(MAX_BONES <= 256, "PackedVertex stores bone ids in a byte");
+static_assert(sizeof(PackedVertex) == 32, "PackedVertex is expected to be 32 bytes");
+
+// maps a unit vector onto the octahedron and unfolds it into [-1, 1]^2
+inline glm::vec2 octEncode(glm::vec3 n) {
+    float length = glm::length(n);
+    if (length < 1e-8f) {
+        n = glm::vec3(0.0f, 0.0f, 1.0f);
+    }
+    n /= (fabs(n.x) + fabs(n.y) + fabs(n.z));
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f) {
+        e = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return e;
+}
+
+inline PackedVertex packVertex(const Vertex &v) {
+    PackedVertex packed;
+    packed.Position = v.Position;
+
+    glm::vec2 normal = octEncode(v.Normal);
+    packed.Normal[0] = (int16_t)glm::round(glm::clamp(normal.x, -1.0f, 1.0f) * 32767.0f);
+    packed.Normal[1] = (int16_t)glm::round(glm::clamp(normal.y, -1.0f, 1.0f) * 32767.0f);
+
+    glm::vec2 tangent = octEncode(v.Tangent);
+    float bitangentSign = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) < 0.0f ? -1.0f : 1.0f;
+    packed.Tangent = glm::packSnorm3x10_1x2(glm::vec4(tangent.x, tangent.y, 0.0f, bitangentSign));
+
+    packed.TexCoords[0] = glm::packHalf1x16(v.TexCoords.x);
+    packed.TexCoords[1] = glm::packHalf1x16(v.TexCoords.y);
+
+    // quantize the weights, then put the rounding error on the largest one so the sum is kept
+    int quantized[MAX_BONES_VERTEX];
+    int total = 0;
+    int largest = 0;
+    float weightSum = 0.0f;
+    for (int b = 0; b < MAX_BONES_VERTEX; b++) {
+        quantized[b] = (int)glm::round(glm::clamp(v.boneWeights[b], 0.0f, 1.0f) * 255.0f);
+        total += quantized[b];
+        weightSum += v.boneWeights[b];
+        if (v.boneWeights[b] > v.boneWeights[largest]) {
+            largest = b;
+        }
+    }
+    quantized[largest] += (int)glm::round(glm::clamp(weightSum, 0.0f, 1.0f) * 255.0f) - total;
+    for (int b = 0; b < MAX_BONES_VERTEX; b++) {
+        packed.boneIds[b] = (uint8_t)v.boneIds[b];
+        packed.boneWeights[b] = (uint8_t)glm::clamp(quantized[b], 0, 255);
+    }
+    return packed;
+}
+
+// sets the attribute pointers of the currently bound VAO for a vertex buffer of the given format.
+// locations match animate.vert
+inline void setupVertexAttributes(Vertex_Format format)
+{
+    if (format == VERTEX_PACKED) {
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+        // octahedral normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+        // half float texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+        // octahedral tangent and bitangent sign, the bitangent itself (location 4) is rebuilt in the shader
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+        // bone ids
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 4, GL_UNSIGNED_BYTE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, boneIds));
+        // unorm8 bone weights
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, boneWeights));
+        return;
+    }
+    // vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // vertex normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    // vertex texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    // vertex tangent
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+    // vertex bitangent
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+    // bone ids
+    glEnableVertexAttribArray(5);
+    glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, boneIds));
+    // bone weights
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, boneWeights));
+}
+
+// points location 2 of the bound VAO at the texture coords of a vertex buffer of the given format
+inline void setupTexCoordAttribute(Vertex_Format format)
+{
+    glEnableVertexAttribArray(2);
+    if (format == VERTEX_PACKED) {
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+    }
+    else {
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    }
+}
+
+// a vertex as written by the skinning stage, already in world space.
+// member order matches the interleaved transform feedback capture of WorldPos and TBN
+struct SkinnedVertex {
+    glm::vec3 Position;
+    glm::vec3 Tangent;
+    glm::vec3 Bitangent;
+    glm::vec3 Normal;
+};
+#endif
@@ -6,16 +6,27 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Shader.h"
+#include "ShaderVariants.h"
 #include "Camera.h"
 #include "Model.h"
+#include "ModelLoader.h"
 #include "Terrain.h"
+#include "GpuTimer.h"
+#include "TextureBaker.h"
+#include "MemoryStats.h"
+#include "FrameUniforms.h"
+#include "GLState.h"
 
 #include <iostream>
+#include <fstream>
+#include <chrono>
+#include <functional>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
+bool run_offline_tool(int argc, char **argv);
 
 // settings
 const unsigned int SCR_WIDTH = 1600;
@@ -30,6 +41,18 @@ bool firstMouse = true;
 
 bool wireframe = false;
 bool nightMode = false;
+// blend distant fragments into the sky, a variant of the lighting pass
+bool fog = true;
+// G-buffer of colour with the material id, octahedron encoded normals and depth (12 bytes a pixel) the position is
+// rebuilt from, instead of float position and normal targets and a material target (44 bytes)
+bool compactGBuffer = true;
+// skin the dragon once per frame into a vertex cache instead of in every pass that draws it
+bool skinCache = true;
+bool printProfile = false;
+// bytes of decoded texture data staged for upload per frame
+const size_t TEXTURE_UPLOAD_BUDGET = 4 * 1024 * 1024;
+// bytes of model geometry copied into the arena per frame while a model streams in
+const size_t MODEL_UPLOAD_BUDGET = 8 * 1024 * 1024;
 glm::vec3 sunClear = glm::vec3(1.0f, 0.99f, 0.96f);//glm::vec3(1.0f, 0.894f, 0.859f);
 glm::vec3 nightClear = glm::vec3(0.098f, 0.098f, 0.4392f);
 int timeout = 10;
@@ -46,50 +69,113 @@ class Application
 {
 public:
     GLFWwindow* window = nullptr;
+    // the dragon loads in the background, it can fly from the start but is only drawn once ready
+    shared_ptr<ModelHandle> toothlessLoad;
     Model* toothless = nullptr;
     GLuint fb_screen;
-    Shader* terrainShader, *modelShader, *lightingShader, *bloomShader, *screenShader, *prog_bloom_pass;
+    Shader* terrainShader, *modelShader, *lightingShader, *bloomShader, *screenShader, *prog_bloom_pass[2];
+    Shader* skinShader, *preskinnedShader;
+    // the variant fog was switched to, it replaces lightingShader once compiled
+    Shader* nextLightingShader = nullptr;
+    bool lightingFog = true;
+    // the G-buffer layout allocated, and the one compactGBuffer was switched to with its variants of the programs
+    // writing the G-buffer. the layout changes once they and the lighting pass for it have compiled
+    bool gbufferCompact = true, gbufferTarget = true;
+    Shader* nextTerrainShader = nullptr, *nextModelShader = nullptr, *nextPreskinnedShader = nullptr;
+    vector<string> toothlessDefines;
+    // the programs above are variants of these, each set up by setup_shader once poll_shaders finds it compiled
+    ShaderVariants* terrainShaders, *modelShaders, *lightingShaders, *screenShaders, *bloomShaders;
+    ShaderVariants* skinShaders, *preskinnedShaders;
+    vector<ShaderVariants*> shaderSets;
+    // camera, sky and time for every program, written once per frame
+    FrameUniforms* frameUniforms;
+    FrameBlock frame;
+    GpuTimer* skinTimer, *modelPassTimer, *terrainPassTimer, *lightingTimer;
+    // frames and time since the last profile report
+    int profileFrames = 0;
+    chrono::steady_clock::time_point profileStart;
     Terrain *ground;
     glm::mat4 projection, view;
     float currentFrame;
-    GLuint texColBuffer, texColBuffer2, texPosBuffer, texNorBuffer, texMatBuffer, texDepthbuffer;
+    GLuint texColBuffer, texColBuffer2, texDepthbuffer;
+    // 0 where the G-buffer layout has no such target
+    GLuint texPosBuffer = 0, texNorBuffer = 0, texMatBuffer = 0;
     GLuint FBO_bloom, FBO_bloom_pass[2], texFBO_bloom_pass[2], texFBO_bloom_rest;
     GLuint quadVAO, quadVBO;
     int framebufferHeight, framebufferWidth;
+    chrono::steady_clock::time_point loadStart;
+    size_t rssBeforeLoad = 0;
+    chrono::steady_clock::time_point shadersStart;
+    bool shadersReported = false;
 
-    int init()
+    // expects the GL functions loaded by main
+    void init()
     {
-
-        // glad: load all OpenGL function pointers
-        // ---------------------------------------
-        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-        {
-            std::cout << "Failed to initialize GLAD" << std::endl;
-            return -1;
-        }
-
         cout << glGetString(GL_VERSION) << endl;
+#ifndef DISABLE_OPENGL_ERROR_CHECKS
+        // driver reported errors where there is a callback for them, CHECKED_GL_CALL polls glGetError elsewhere
+        if (!GLSL::enableDebugOutput()) {
+            cout << "no OpenGL debug output, checking errors with glGetError" << endl;
+        }
+#endif
 
         // configure global opengl state
         // -----------------------------
         glEnable(GL_DEPTH_TEST);
 
-        // build and compile shaders
+        frameUniforms = new FrameUniforms();
+
+        shadersStart = chrono::steady_clock::now();
+        // build and compile shaders, all are submitted before any is waited on. passes start drawing as their programs are ready.
+        // options are compiled into variants (ShaderVariants.h), others than the ones asked for here when first used
         // -------------------------
-        modelShader = new Shader("./resources/animate.vert", "./resources/animate.frag");
-        terrainShader = new Shader("./resources/terrain.vert", "./resources/terrain.frag");
-        //Shader stillModelShader("./resources/still.vert", "./resources/still.frag");
-        lightingShader = new Shader("./resources/fbo.vert", "./resources/fbo.frag");
-        screenShader = new Shader("./resources/general.vert", "./resources/screen.frag");
-        prog_bloom_pass = new Shader("./resources/general.vert", "./resources/bloom_pass.frag");
+        modelShaders = new ShaderVariants("./resources/animate.vert", "./resources/animate.frag");
+        terrainShaders = new ShaderVariants("./resources/terrain.vert", "./resources/terrain.frag");
+        lightingShaders = new ShaderVariants("./resources/fbo.vert", "./resources/fbo.frag");
+        screenShaders = new ShaderVariants("./resources/general.vert", "./resources/screen.frag");
+        bloomShaders = new ShaderVariants("./resources/general.vert", "./resources/bloom_pass.frag");
+        // skinning stage: animate.vert with its world space outputs captured into the skin cache
+        skinShaders = new ShaderVariants("./resources/animate.vert", {"WorldPos", "TBN"});
+        preskinnedShaders = new ShaderVariants("./resources/preskinned.vert", "./resources/animate.frag");
+        shaderSets = {terrainShaders, lightingShaders, screenShaders, bloomShaders, modelShaders, skinShaders, preskinnedShaders};
+        for (ShaderVariants *set : shaderSets) {
+            set->setup = [this, set](Shader *shader) { setup_shader(set, shader); };
+        }
+        gbufferCompact = gbufferTarget = compactGBuffer;
+        terrainShader = terrainShaders->get(gbuffer_defines({}, gbufferCompact));
+        lightingShader = lightingShaders->get(lighting_defines(gbufferCompact));
+        screenShader = screenShaders->get({});
+        prog_bloom_pass[0] = bloomShaders->get({});
+        prog_bloom_pass[1] = bloomShaders->get({"HORIZONTAL"});
+
+        skinTimer = new GpuTimer("skinning stage");
+        modelPassTimer = new GpuTimer("dragon G-buffer pass");
+        terrainPassTimer = new GpuTimer("G-buffer clear and terrain pass");
+        lightingTimer = new GpuTimer("lighting pass");
+        profileStart = chrono::steady_clock::now();
 
         ground = new Terrain("./resources/terrain/testtopo.png");
 
-        // load models
-        toothless = new Model("./resources/models/toothlessGLTF/scene.gltf", false, true);
+        // load models in the background, preferring the baked file (made with --bake) since it skips the import entirely
+        // dual quaternion skinning keeps the wing joints from collapsing when they twist,
+        // packed vertices cut the vertex fetch of the skinning pass to a third.
+        // the CPU geometry is kept for collision against the skinned dragon (Model::SkinOnCpu)
+        const char *toothlessBaked = "./resources/models/toothlessGLTF/scene.tfm";
+        const char *toothlessSource = ifstream(toothlessBaked).good() ? toothlessBaked : "./resources/models/toothlessGLTF/scene.gltf";
+        loadStart = chrono::steady_clock::now();
+        rssBeforeLoad = memory_stats::currentRss();
+        toothlessLoad = ModelLoader::instance().load(toothlessSource, false, true, SKINNING_DUAL_QUAT, VERTEX_PACKED, GEOMETRY_KEEP);
+        toothless = toothlessLoad->model();
         models.push_back(toothless);
         toothless->position = glm::vec3(0.0f, -0.5f, -3.0f);
 
+        // the dragon's variants follow from how it is loaded, so they compile while it streams in
+        toothlessDefines = toothless->shaderDefines();
+        toothlessDefines.push_back("NORMAL_MAP");
+        modelShader = modelShaders->get(gbuffer_defines(toothlessDefines, gbufferCompact));
+        skinShader = skinShaders->get(toothless->shaderDefines());
+        preskinnedShader = preskinnedShaders->get(gbuffer_defines({"NORMAL_MAP"}, gbufferCompact));
+
         // quad for framebuffer
         float quadVertices[] = { // vertex attributes for a quad that fills the entire screen in Normalized Device Coordinates.
             // positions   // texCoords
@@ -112,26 +198,6 @@ public:
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
 
 
-        GLuint Tex1Location = glGetUniformLocation(lightingShader->ID, "colTex");//tex, tex2... sampler in the fragment shader
-        GLuint Tex2Location = glGetUniformLocation(lightingShader->ID, "posTex");
-        GLuint Tex3Location = glGetUniformLocation(lightingShader->ID, "norTex");
-        GLuint Tex4Location = glGetUniformLocation(lightingShader->ID, "matTex");
-        GLuint Tex5Location = glGetUniformLocation(lightingShader->ID, "depthTexture");
-        // Then bind the uniform samplers to texture units:
-        glUseProgram(lightingShader->ID);
-        glUniform1i(Tex1Location, 0);
-        glUniform1i(Tex2Location, 1);
-        glUniform1i(Tex3Location, 2);
-        glUniform1i(Tex4Location, 3);
-        glUniform1i(Tex5Location, 4);
-
-        Tex1Location = glGetUniformLocation(lightingShader->ID, "colTex");//tex, tex2... sampler in the fragment shader
-        Tex2Location = glGetUniformLocation(lightingShader->ID, "bloomTex");
-        // Then bind the uniform samplers to texture units:
-        glUseProgram(screenShader->ID);
-        glUniform1i(Tex1Location, 0);
-        glUniform1i(Tex2Location, 1);
-
 
         // render to framebuffer for deferred shading
         glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
@@ -145,30 +211,6 @@ public:
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texColBuffer, 0);
 
-        // create a position texture
-        glGenTextures(1, &texPosBuffer);
-        glBindTexture(GL_TEXTURE_2D, texPosBuffer);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, texPosBuffer, 0);
-
-        // create a normal texture
-        glGenTextures(1, &texNorBuffer);
-        glBindTexture(GL_TEXTURE_2D, texNorBuffer);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, texNorBuffer, 0);
-
-        // create a material texture
-        glGenTextures(1, &texMatBuffer);
-        glBindTexture(GL_TEXTURE_2D, texMatBuffer);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, texMatBuffer, 0);
-
         glGenTextures(1, &texDepthbuffer);
         glBindTexture(GL_TEXTURE_2D, texDepthbuffer);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, framebufferWidth, framebufferHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
@@ -178,11 +220,85 @@ public:
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texDepthbuffer, 0);
 
+        // the normal (and position and material) targets depend on the layout
+        generate_gbuffer_targets();
+
+        generate_bloom_FBO();
+        // the setup above binds directly, from here on every frame goes through GLState
+        GLState::instance().invalidate();
+    }
+
+    // (re)creates the G-buffer targets of the layout in gbufferCompact after colour and depth. leaves fb_screen
+    // bound and the state behind GLState's back
+    void generate_gbuffer_targets()
+    {
+        GLuint targets[] = { texPosBuffer, texNorBuffer, texMatBuffer };
+        glDeleteTextures(3, targets);
+        texPosBuffer = texNorBuffer = texMatBuffer = 0;
+        glBindFramebuffer(GL_FRAMEBUFFER, fb_screen);
+
+        if (gbufferCompact) {
+            // create an octahedron encoded normal texture, not filtered since neighbouring encodings don't blend
+            glGenTextures(1, &texNorBuffer);
+            glBindTexture(GL_TEXTURE_2D, texNorBuffer);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, framebufferWidth, framebufferHeight, 0, GL_RG, GL_UNSIGNED_SHORT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, texNorBuffer, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, 0, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, 0, 0);
+        }
+        else {
+            // create a position texture
+            glGenTextures(1, &texPosBuffer);
+            glBindTexture(GL_TEXTURE_2D, texPosBuffer);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, texPosBuffer, 0);
+
+            // create a normal texture
+            glGenTextures(1, &texNorBuffer);
+            glBindTexture(GL_TEXTURE_2D, texNorBuffer);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, texNorBuffer, 0);
+
+            // create a material texture
+            glGenTextures(1, &texMatBuffer);
+            glBindTexture(GL_TEXTURE_2D, texMatBuffer);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, texMatBuffer, 0);
+        }
+
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
             cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << endl;
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
 
-        generate_bloom_FBO();
+    // bytes of G-buffer written by the geometry passes and read by the lighting pass per pixel
+    int gbuffer_bytes_per_pixel() const
+    {
+        // colour and depth, then octahedron normals or float position and normal and the material
+        return 4 + 4 + (gbufferCompact ? 4 : 16 + 16 + 4);
+    }
+
+    // defines of the programs writing the G-buffer in the compact layout or not
+    static vector<string> gbuffer_defines(vector<string> defines, bool compact)
+    {
+        if (compact) {
+            defines.push_back("COMPACT_GBUFFER");
+        }
+        return defines;
+    }
+
+    // defines of the lighting pass reading the compact G-buffer or not, with fog as switched
+    vector<string> lighting_defines(bool compact) const
+    {
+        return gbuffer_defines(lightingFog ? vector<string>{"FOG"} : vector<string>{}, compact);
     }
 
     void generate_bloom_FBO()
@@ -244,9 +360,70 @@ public:
 
     }
 
+    // sets up the programs that finished compiling since the last call, without waiting on the rest
+    void poll_shaders()
+    {
+        bool compiling = false;
+        for (ShaderVariants *set : shaderSets) {
+            compiling = !set->poll() || compiling;
+        }
+        if (nextLightingShader && nextLightingShader->ready()) {
+            lightingShader = nextLightingShader;
+            nextLightingShader = nullptr;
+        }
+        if (gbufferTarget != gbufferCompact) {
+            Shader *lighting = lightingShaders->get(lighting_defines(gbufferTarget));
+            if (nextTerrainShader->ready() && nextModelShader->ready() && nextPreskinnedShader->ready() && lighting->ready()) {
+                gbufferCompact = gbufferTarget;
+                terrainShader = nextTerrainShader;
+                modelShader = nextModelShader;
+                preskinnedShader = nextPreskinnedShader;
+                lightingShader = lighting;
+                nextLightingShader = nullptr;
+                generate_gbuffer_targets();
+                GLState::instance().invalidate();
+                cout << (gbufferCompact ? "compact" : "full") << " G-buffer, " << gbuffer_bytes_per_pixel() << " bytes per pixel" << endl;
+            }
+        }
+        if (!compiling && !shadersReported) {
+            shadersReported = true;
+            cout << "shader programs: " << program_cache::stats().hits << " from the binary cache, " << program_cache::stats().misses
+                 << " compiled, ready after " << chrono::duration<double, milli>(chrono::steady_clock::now() - shadersStart).count() << " ms" << endl;
+        }
+    }
+
+    // waits for every program, for the offline tools
+    void finish_shaders()
+    {
+        for (ShaderVariants *set : shaderSets) {
+            set->finish();
+        }
+        poll_shaders();
+    }
+
+    // the state of a program that only has to be set once, after linking. shader is a variant of set
+    void setup_shader(ShaderVariants *set, Shader *shader)
+    {
+        frameUniforms->attach(shader);
+        if (set == lightingShaders) {
+            // bind the uniform samplers (tex, tex2... in the fragment shader) to texture units
+            shader->use();
+            shader->setInt("colTex", 0);
+            shader->setInt("posTex", 1);
+            shader->setInt("norTex", 2);
+            shader->setInt("matTex", 3);
+            shader->setInt("depthTexture", 4);
+        }
+        else if (set == screenShaders) {
+            shader->use();
+            shader->setInt("colTex", 0);
+            shader->setInt("bloomTex", 1);
+        }
+    }
+
     void setup_render()
     {
-        glViewport(0, 0, framebufferWidth, framebufferHeight);
+        GLState::instance().viewport(0, 0, framebufferWidth, framebufferHeight);
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
         // per-frame time logic
@@ -254,11 +431,30 @@ public:
         currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        profileFrames++;
+
+        // stream in programs that finished compiling, models that finished importing and textures that finished decoding
+        poll_shaders();
+        ModelLoader::instance().pump(MODEL_UPLOAD_BUDGET);
+        TextureLoader::instance().pump(TEXTURE_UPLOAD_BUDGET);
 
         // input
         // -----
         timeout--;
         processInput(window);
+        // the lighting pass keeps its current variant until the one fog was switched to has compiled
+        if (fog != lightingFog) {
+            lightingFog = fog;
+            nextLightingShader = lightingShaders->get(lighting_defines(gbufferCompact));
+        }
+        // and the G-buffer keeps its layout until every program of the other one has
+        if (compactGBuffer != gbufferTarget) {
+            gbufferTarget = compactGBuffer;
+            nextTerrainShader = terrainShaders->get(gbuffer_defines({}, gbufferTarget));
+            nextModelShader = modelShaders->get(gbuffer_defines(toothlessDefines, gbufferTarget));
+            nextPreskinnedShader = preskinnedShaders->get(gbuffer_defines({"NORMAL_MAP"}, gbufferTarget));
+            lightingShaders->get(lighting_defines(gbufferTarget));
+        }
 
         toothless->debugTime = debugTime;
         toothless->updatePosition(deltaTime);
@@ -269,15 +465,37 @@ public:
         glm::mat4 v = camera.GetViewMatrix();
         view = glm::rotate(glm::mat4(1.0f), glm::radians(0.0f), toothless->direction);
         view *= v;
+
+        // one write for every program that reads the camera, sky or time this frame
+        frame.projection = projection;
+        frame.view = view;
+        frame.campos = camera.Position;
+        frame.time = currentFrame;
+        frame.skyColor = nightMode ? nightClear : sunClear;
+        frame.inverseViewProjection = glm::inverse(projection * view);
+        frameUniforms->update(frame);
     }
 
     void render_to_texture()
     {
-        glViewport(0, 0, framebufferWidth, framebufferHeight);
-        glBindFramebuffer(GL_FRAMEBUFFER, fb_screen);
+        bool drawToothless = toothlessLoad->ready() && (skinCache ? skinShader->ready() && preskinnedShader->ready() : modelShader->ready());
+        if (drawToothless) {
+            toothless->setCamera(projection, view, (float)framebufferHeight);
+        }
+        if (skinCache && drawToothless) {
+            skinTimer->begin();
+            toothless->Skin(skinShader, currentFrame);
+            skinTimer->end();
+        }
+
+        GLState &gl = GLState::instance();
+        gl.viewport(0, 0, framebufferWidth, framebufferHeight);
+        gl.bindFramebuffer(fb_screen);
         GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
-        glDrawBuffers(4, buffers);
-        glEnable(GL_DEPTH_TEST);
+        gl.drawBuffers(gbufferCompact ? 2 : 4, buffers);
+        gl.enable(GL_DEPTH_TEST);
+
+        terrainPassTimer->begin();
 
         //******************************************************************
         if (nightMode) {
@@ -289,115 +507,253 @@ public:
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // draw the ground
-        terrainShader->use();
-        terrainShader->setMat4("projection", projection);
-        terrainShader->setMat4("view", view);
-        ground->Draw(terrainShader);
+        if (terrainShader->ready()) {
+            terrainShader->use();
+            ground->Draw(terrainShader, projection, view);
+        }
+        terrainPassTimer->end();
 
-        modelShader->use();
-        // view/projection transformations
-        modelShader->setMat4("projection", projection);
-        modelShader->setMat4("view", view);
-        // render the loaded model
-        toothless->Draw(modelShader, currentFrame);
+        modelPassTimer->begin();
+        // until the dragon has streamed in the terrain is drawn on its own
+        if (drawToothless && skinCache) {
+            preskinnedShader->use();
+            toothless->DrawSkinned(preskinnedShader);
+        }
+        else if (drawToothless) {
+            modelShader->use();
+            // render the loaded model
+            toothless->Draw(modelShader, currentFrame);
+        }
+        modelPassTimer->end();
+    }
+
+    void report_profile()
+    {
+        cout << "skin cache " << (skinCache ? "on" : "off") << ", dragon LOD " << toothless->lod()
+             << (toothless->lodOverride >= 0 ? " (pinned)" : "") << ", clusters " << toothless->clustersDrawn() << "/" << toothless->clusterCount()
+             << (toothless->clusterCulling ? "" : " (culling off)") << endl;
+        double frameMs = chrono::duration<double, milli>(chrono::steady_clock::now() - profileStart).count() / max(profileFrames, 1);
+        double gbufferMB = (double)gbuffer_bytes_per_pixel() * framebufferWidth * framebufferHeight / (1024.0 * 1024.0);
+        cout << (gbufferCompact ? "compact" : "full") << " G-buffer: " << gbuffer_bytes_per_pixel() << " bytes per pixel, "
+             << gbufferMB << " MB written and read per frame, " << frameMs << " ms per frame (avg of " << profileFrames << " frames)" << endl;
+        profileStart = chrono::steady_clock::now();
+        profileFrames = 0;
+        skinTimer->report();
+        terrainPassTimer->report();
+        modelPassTimer->report();
+        lightingTimer->report();
+        GLState::instance().report();
+        TextureCache::instance().report();
     }
 
     void render_lighting()
     {
-        glViewport(0, 0, framebufferWidth, framebufferHeight);
-        glBindFramebuffer(GL_FRAMEBUFFER, FBO_bloom);
-        glDisable(GL_DEPTH_TEST); // disable depth test so screen-space quad isn't discarded due to depth test.
+        GLState &gl = GLState::instance();
+        gl.viewport(0, 0, framebufferWidth, framebufferHeight);
+        gl.bindFramebuffer(FBO_bloom);
+        gl.disable(GL_DEPTH_TEST); // disable depth test so screen-space quad isn't discarded due to depth test.
         // clear all relevant buffers
         glClearColor(1.0f, 1.0f, 1.0f, 1.0f); // set clear color to white (not really necessery actually, since we won't be able to see behind the quad anyways)
         glClear(GL_COLOR_BUFFER_BIT);
         GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
-        glDrawBuffers(2, buffers);
+        gl.drawBuffers(2, buffers);
+        if (!lightingShader->ready()) {
+            return;
+        }
 
         lightingShader->use();
-        glBindVertexArray(quadVAO);
+        gl.bindVertexArray(quadVAO);
 
-        lightingShader->setVec3("skyColor", nightMode ? nightClear : sunClear);
-        lightingShader->setVec3("campos", camera.Position);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texColBuffer);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texPosBuffer);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, texNorBuffer);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, texMatBuffer);
-
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, texDepthbuffer);
+        gl.bindTexture(0, texColBuffer);
+        if (!gbufferCompact) {
+            gl.bindTexture(1, texPosBuffer);
+            gl.bindTexture(3, texMatBuffer);
+        }
+        gl.bindTexture(2, texNorBuffer);
+        gl.bindTexture(4, texDepthbuffer);
 
+        lightingTimer->begin();
         glDrawArrays(GL_TRIANGLES, 0, 6);
+        lightingTimer->end();
 
-        glBindTexture(GL_TEXTURE_2D, texFBO_bloom_rest);
+        // on a unit of their own, so the G-buffer stays bound for the next frame
+        gl.bindTexture(5, texFBO_bloom_rest);
+        gl.activeTexture(5);
         glGenerateMipmap(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, texFBO_bloom_pass[0]);
+        gl.bindTexture(5, texFBO_bloom_pass[0]);
         glGenerateMipmap(GL_TEXTURE_2D);
     }
 
     void render_to_screen()
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState &gl = GLState::instance();
+        gl.bindFramebuffer(0);
         glClearColor(0.0, 1.0, 0.0, 1.0);
         int width, height;
         glfwGetFramebufferSize(window, &width, &height);
         float aspect = width / (float)height;
-        glViewport(0, 0, width, height);
+        gl.viewport(0, 0, width, height);
         // Clear framebuffer.
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (!screenShader->ready()) {
+            return;
+        }
 
         screenShader->use();
-        glBindVertexArray(quadVAO);
+        gl.bindVertexArray(quadVAO);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texFBO_bloom_rest);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texFBO_bloom_pass[0]);
+        gl.bindTexture(0, texFBO_bloom_rest);
+        gl.bindTexture(1, texFBO_bloom_pass[0]);
 
         glDrawArrays(GL_TRIANGLES, 0, 6);
     }
 
     void render_bloompass(int pass)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, FBO_bloom_pass[pass]);
+        GLState &gl = GLState::instance();
+        gl.bindFramebuffer(FBO_bloom_pass[pass]);
         GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-        glDrawBuffers(1, buffers);
+        gl.drawBuffers(1, buffers);
         // Get current frame buffer size.
 
         int width, height;
         glfwGetFramebufferSize(window, &width, &height);
         float aspect = width / (float)height;
-        glViewport(0, 0, width, height);
+        gl.viewport(0, 0, width, height);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // pass 1 blurs horizontally, 0 vertically
+        if (!prog_bloom_pass[pass]->ready()) {
+            return;
+        }
 
-        prog_bloom_pass->use();
-        prog_bloom_pass->setInt("horizontal", pass);
+        prog_bloom_pass[pass]->use();
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texFBO_bloom_pass[!pass]);
-        glBindVertexArray(quadVAO);
+        gl.bindTexture(0, texFBO_bloom_pass[!pass]);
+        gl.bindVertexArray(quadVAO);
         glDrawArrays(GL_TRIANGLES, 0, 6);
 
-        glBindTexture(GL_TEXTURE_2D, texFBO_bloom_pass[pass]);
+        gl.bindTexture(1, texFBO_bloom_pass[pass]);
+        gl.activeTexture(1);
         glGenerateMipmap(GL_TEXTURE_2D);
 
 
     }
+
+    // times the uniforms a frame sets over many frames: the model matrices of the terrain and the dragon queried by name,
+    // through the reflected names and through handles, then with the frame block written as well. the skinning and
+    // bloom switches that used to be set here too are compiled into variants now
+    void bench_uniforms(int frames)
+    {
+        auto queried = [&](Shader *shader, const char *name) { return glGetUniformLocation(shader->ID, name); };
+        auto timeFrames = [&](const char *label, const std::function<void()> &frame) {
+            glFinish();
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < frames; i++) {
+                frame();
+            }
+            glFinish();
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            cout << label << ": " << ms * 1000.0 / frames << " us per frame" << endl;
+        };
+        timeFrames("glGetUniformLocation per call", [&]() {
+            terrainShader->use();
+            glUniformMatrix4fv(queried(terrainShader, "model"), 1, GL_FALSE, &view[0][0]);
+            modelShader->use();
+            glUniformMatrix4fv(queried(modelShader, "model"), 1, GL_FALSE, &view[0][0]);
+        });
+        timeFrames("reflected names", [&]() {
+            terrainShader->use();
+            terrainShader->setMat4("model", view);
+            modelShader->use();
+            modelShader->setMat4("model", view);
+        });
+        UniformHandle terrainModel = terrainShader->uniform("model"), modelModel = modelShader->uniform("model");
+        auto handles = [&]() {
+            terrainShader->use();
+            terrainShader->setMat4(terrainModel, view);
+            modelShader->use();
+            modelShader->setMat4(modelModel, view);
+        };
+        timeFrames("handles", handles);
+        timeFrames("handles and frame block", [&]() {
+            frameUniforms->update(frame);
+            handles();
+        });
+    }
+
+    // times uploading and drawing the terrain, whose GL calls are all CHECKED_GL_CALLs, with the errors polled
+    // after every call and reported through debug output, asynchronous and synchronous. one mode in release
+    // builds, which compile the checks out
+    void bench_gl_checks(int frames)
+    {
+        auto timeTerrain = [&](const char *label) {
+            int uploads = max(1, frames / 100);
+            glFinish();
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < uploads; i++) {
+                ground->init();
+            }
+            glFinish();
+            double uploadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / uploads;
+            terrainShader->use();
+            start = chrono::steady_clock::now();
+            for (int i = 0; i < frames; i++) {
+                ground->Draw(terrainShader, projection, view);
+            }
+            glFinish();
+            double drawUs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() * 1000.0 / frames;
+            cout << label << ": upload " << uploadMs << " ms, draw " << drawUs << " us" << endl;
+        };
+        projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        view = camera.GetViewMatrix();
+        // the upload loop is timed without console output
+        ground->initReport = false;
+#ifdef DISABLE_OPENGL_ERROR_CHECKS
+        timeTerrain("checks compiled out");
+#else
+        GLSL::disableDebugOutput();
+        timeTerrain("glGetError around each call");
+        if (!GLSL::enableDebugOutput()) {
+            cout << "no OpenGL debug output on this context" << endl;
+            ground->initReport = true;
+            return;
+        }
+        timeTerrain("debug output");
+        GLSL::enableDebugOutput(true);
+        timeTerrain("synchronous debug output");
+        GLSL::enableDebugOutput();
+#endif
+        ground->initReport = true;
+    }
 };
 
 
-int main()
+int main(int argc, char **argv)
 {
+    auto startTime = chrono::steady_clock::now();
+
     // glfw window creation
     // --------------------
     if (!glfwInit()) {
         return -1;
     }
+    // hints only apply to windows created after them
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifndef DISABLE_OPENGL_ERROR_CHECKS
+    // drivers only report everything through the debug output of a debug context
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+#endif
     GLFWwindow* window = glfwCreateWindow(1600, 900, "Hello, World!", NULL, NULL);
     if (window == NULL)
+    {
+        // macOS stops at 4.1 and only creates core contexts that are forward compatible
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        window = glfwCreateWindow(1600, 900, "Hello, World!", NULL, NULL);
+    }
+    if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -408,25 +764,92 @@ int main()
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    
     // tell GLFW to capture our mouse
     //glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSwapInterval(1);
 
+    // glad: load all OpenGL function pointers
+    // ---------------------------------------
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    GLSL::loadDebugOutput((GLADloadproc)glfwGetProcAddress);
+
+    // offline tools that only need a context run before the application starts streaming the dragon
+    // and its textures, so no loader thread competes with them
+    if (argc > 1 && run_offline_tool(argc, argv)) {
+        glfwTerminate();
+        return 0;
+    }
 
     Application* app = new Application();
     app->window = window;
     app->init();
+
+    // offline tools measuring the application, these run instead of the flight simulator
+    if (argc > 1) {
+        string command = argv[1];
+        app->finish_shaders();
+        if (command == "--bench-skinning") {
+            // compare the scalar and SIMD CPU skinning paths on the dragon
+            ModelLoader::instance().finish();
+            app->toothless->updatePose(0.0);
+            for (unsigned int i = 0; i < app->toothless->meshes.size(); i++) {
+                cpu_skinning::benchmark(app->toothless->meshes[i], app->toothless->animationTransforms.data());
+            }
+        }
+        else if (command == "--bench-uniforms") {
+            // --bench-uniforms [frames]: CPU cost of the per-frame uniform calls, queried by name as they used to be,
+            // through the reflected names and through handles, and of writing the frame block
+            int frames = argc > 2 ? max(1, atoi(argv[2])) : 10000;
+            app->bench_uniforms(frames);
+        }
+        else if (command == "--bench-gl-checks") {
+            // --bench-gl-checks [frames]: cost of the GL error checks on the terrain upload and draw in each mode
+            int frames = argc > 2 ? max(1, atoi(argv[2])) : 10000;
+            app->bench_gl_checks(frames);
+        }
+        else {
+            cout << "usage: " << argv[0] << " [--bench-skinning | --bench-load <model> [runs] | --bench-uniforms [frames] | --bench-gl-checks [frames] | --bake <model> <out.tfm> [static] | --bake-texture <image> [normal | data]]" << endl;
+        }
+        ModelLoader::instance().shutdown();
+        glfwTerminate();
+        return 0;
+    }
     // render loop
     // -----------
+    int frameCount = 0;
+    bool texturesStreaming = true;
+    bool modelsStreaming = true;
     while (!glfwWindowShouldClose(window))
     {
         glfwSwapBuffers(window);
         glfwPollEvents();
 
+        // the first swap shows placeholder textures, the real ones follow as they are decoded
+        frameCount++;
+        if (frameCount == 2) {
+            cout << "time to first frame: " << chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count() << " ms" << endl;
+        }
+        if (modelsStreaming && ModelLoader::instance().idle()) {
+            if (app->toothlessLoad->ready()) {
+                cout << "loaded " << app->toothlessLoad->path() << " after "
+                     << chrono::duration<double, milli>(chrono::steady_clock::now() - app->loadStart).count() << " ms" << endl;
+                cout << "model load RSS: " << memory_stats::megabytes(app->rssBeforeLoad) << " MB before, "
+                     << memory_stats::megabytes(memory_stats::peakRss()) << " MB peak, "
+                     << memory_stats::megabytes(memory_stats::currentRss()) << " MB after" << endl;
+            }
+            modelsStreaming = false;
+        }
+        if (texturesStreaming && !modelsStreaming && TextureLoader::instance().idle()) {
+            cout << "textures streamed in after " << chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count()
+                 << " ms (" << TextureLoader::instance().uploadedBytes() / (1024 * 1024) << " MB)" << endl;
+            texturesStreaming = false;
+        }
+
         app->setup_render();
         app->render_to_texture();
         app->render_lighting();
@@ -435,15 +858,81 @@ int main()
         app->render_bloompass(0);
         app->render_bloompass(1);
         app->render_to_screen();
+        GLState::instance().endFrame();
+
+        if (printProfile) {
+            app->report_profile();
+            printProfile = false;
+        }
 
     }
 
+    // models still loading are freed while there is a context to delete their buffers in
+    ModelLoader::instance().shutdown();
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
     return 0;
 }
 
+// offline tools needing no more than a GL context: baking and load timing. false if argv names none of them
+// ---------------------------------------------------------------------------------------------------------
+bool run_offline_tool(int argc, char **argv)
+{
+    string command = argv[1];
+    if (command == "--bake" && argc > 3) {
+        // --bake <model> <out.tfm> [static]: import a model and write it in the baked format
+        bool animated = !(argc > 4 && string(argv[4]) == "static");
+        Model source(argv[2], false, animated, SKINNING_LINEAR_BLEND, VERTEX_FULL, GEOMETRY_KEEP);
+        source.Bake(argv[3]);
+        // and its textures, which the loader picks up next to the originals
+        for (unsigned int i = 0; i < source.textures_loaded.size(); i++) {
+            const Texture &texture = source.textures_loaded[i];
+            string image = source.directory + '/' + texture.path;
+            texture_baker::bake(image, ktx2::bakedPath(image), texture_baker::kindOf(texture.type));
+        }
+        return true;
+    }
+    if (command == "--bench-load" && argc > 2) {
+        // --bench-load <model> [runs]: time Model::import of an animated model, nothing is uploaded or printed while
+        // the clock runs. .gltf files are imported both natively and through assimp
+        int runs = argc > 3 ? max(1, atoi(argv[3])) : 5;
+        string path = argv[2];
+        bool gltfFile = path.size() > 5 && path.compare(path.size() - 5, 5, ".gltf") == 0;
+        auto benchLoad = [&](bool nativeGltf) {
+            double total = 0.0;
+            for (int i = 0; i < runs; i++) {
+                Model model(path, false, true, SKINNING_LINEAR_BLEND, VERTEX_FULL, GEOMETRY_RELEASE, LOAD_DEFERRED);
+                model.nativeGltf = nativeGltf;
+                model.importReport = false;
+                auto importStart = chrono::steady_clock::now();
+                model.import(path);
+                total += chrono::duration<double, milli>(chrono::steady_clock::now() - importStart).count();
+            }
+            return total / runs;
+        };
+        double nativeMs = benchLoad(true);
+        cout << "import " << path << ": " << nativeMs << " ms average over " << runs << " runs" << (gltfFile ? " (native glTF)" : "") << endl;
+#ifndef TOOTHLESS_NO_ASSIMP
+        if (gltfFile) {
+            double assimpMs = benchLoad(false);
+            cout << "import " << path << ": " << assimpMs << " ms average over " << runs << " runs (assimp), "
+                 << assimpMs / max(nativeMs, 1e-3) << "x the native import" << endl;
+        }
+#endif
+        return true;
+    }
+    if (command == "--bake-texture" && argc > 2) {
+        // --bake-texture <image> [normal | data]: mip and block compress one image into <image>.ktx2.
+        // data is for linear maps such as metallic/roughness, colour is filtered in linear space
+        string kind = argc > 3 ? argv[3] : "";
+        texture_baker::bake(argv[2], ktx2::bakedPath(argv[2]), kind == "normal" ? texture_baker::TEXTURE_NORMAL :
+                            (kind == "data" ? texture_baker::TEXTURE_DATA : texture_baker::TEXTURE_COLOR));
+        return true;
+    }
+    return false;
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow *window)
@@ -463,6 +952,49 @@ void processInput(GLFWwindow *window)
             timeout = 10;
         }
     }
+    if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS) {
+        if (timeout <= 0) {
+            fog = !fog;
+            timeout = 10;
+        }
+    }
+    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) {
+        // switch between the compact and the full G-buffer, to compare them with the profile (P)
+        if (timeout <= 0) {
+            compactGBuffer = !compactGBuffer;
+            timeout = 10;
+        }
+    }
+    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) {
+        if (timeout <= 0) {
+            skinCache = !skinCache;
+            timeout = 10;
+        }
+    }
+    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) {
+        // cycle the dragon through automatic and each pinned level of detail
+        if (timeout <= 0) {
+            for (auto it = models.begin(); it != models.end(); it++) {
+                (*it)->lodOverride = (*it)->lodOverride + 1 < (int)LOD_LEVELS ? (*it)->lodOverride + 1 : -1;
+            }
+            timeout = 10;
+        }
+    }
+    if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS) {
+        // toggle cluster culling on the dragon
+        if (timeout <= 0) {
+            for (auto it = models.begin(); it != models.end(); it++) {
+                (*it)->clusterCulling = !(*it)->clusterCulling;
+            }
+            timeout = 10;
+        }
+    }
+    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
+        if (timeout <= 0) {
+            printProfile = true;
+            timeout = 10;
+        }
+    }
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) {
         sunX -= 1;
     }
@@ -479,7 +1011,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    GLState::instance().viewport(0, 0, width, height);
 }
 
 // glfw: whenever the mouse moves, this callback is called